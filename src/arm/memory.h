@@ -1,5 +1,6 @@
 #pragma once
 
+#include <algorithm>
 #include "common/types.h"
 #include "common/logger.h"
 #include "common/memory.h"
@@ -34,23 +35,31 @@ public:
         static_assert(is_one_of_v<T, u8, u16, u32>, "T is not valid");
         addr &= ~(sizeof(T) - 1);
 
-        // TODO: add back
-        // if constexpr (B != Bus::System) {
+        // each bus has its own page table with the tcm regions it can see mapped in,
+        // so the common case is a single lookup
+        auto pointer = get_read_table<B>().template get_pointer<T>(addr);
+        if (pointer) {
+            return common::read<T>(pointer);
+        }
+
+        // tcm regions which only partially cover a page can't be placed in the page table
+        if constexpr (B != Bus::System) {
             if (itcm.config.enable_reads && addr >= itcm.config.base && addr < itcm.config.limit) {
                 return common::read<T>(itcm.data, (addr - itcm.config.base) & itcm.mask);
             }
-        // }
+        }
 
-        // TODO: add back
-        // if constexpr (B == Bus::Data) {
+        if constexpr (B == Bus::Data) {
             if (dtcm.config.enable_reads && addr >= dtcm.config.base && addr < dtcm.config.limit) {
                 return common::read<T>(dtcm.data, (addr - dtcm.config.base) & dtcm.mask);
             }
-        // }
+        }
 
-        auto pointer = read_table.get_pointer<T>(addr);
-        if (pointer) {
-            return common::read<T>(pointer);
+        if constexpr (B != Bus::System) {
+            pointer = read_table.get_pointer<T>(addr);
+            if (pointer) {
+                return common::read<T>(pointer);
+            }
         }
 
         if (std::is_same_v<T, u8>) {
@@ -67,26 +76,32 @@ public:
         static_assert(is_one_of_v<T, u8, u16, u32>, "T is not valid");
         addr &= ~(sizeof(T) - 1);
 
-        // TODO: add back
-        // if constexpr (B != Bus::System) {
+        auto pointer = get_write_table<B>().template get_pointer<T>(addr);
+        if (pointer) {
+            common::write<T>(pointer, value);
+            return;
+        }
+
+        if constexpr (B != Bus::System) {
             if (itcm.config.enable_writes && addr >= itcm.config.base && addr < itcm.config.limit) {
                 common::write<T>(itcm.data, value, (addr - itcm.config.base) & itcm.mask);
                 return;
             }
-        // }
+        }
 
-        // TODO: add back
-        // if constexpr (B == Bus::Data) {
+        if constexpr (B == Bus::Data) {
             if (dtcm.config.enable_writes && addr >= dtcm.config.base && addr < dtcm.config.limit) {
                 common::write<T>(dtcm.data, value, (addr - dtcm.config.base) & dtcm.mask);
                 return;
             }
-        // }
+        }
 
-        auto pointer = write_table.get_pointer<T>(addr);
-        if (pointer) {
-            common::write<T>(pointer, value);
-            return;
+        if constexpr (B != Bus::System) {
+            pointer = write_table.get_pointer<T>(addr);
+            if (pointer) {
+                common::write<T>(pointer, value);
+                return;
+            }
         }
 
         if (std::is_same_v<T, u8>) {
@@ -101,21 +116,44 @@ public:
     void map(u32 base, u32 end, u8* pointer, u32 mask, RegionAttributes attributes) {
         if (attributes & RegionAttributes::Read) {
             read_table.map(base, end, pointer, mask);
+            code_read_table.map(base, end, pointer, mask);
+            data_read_table.map(base, end, pointer, mask);
         }
 
         if (attributes & RegionAttributes::Write) {
             write_table.map(base, end, pointer, mask);
+            code_write_table.map(base, end, pointer, mask);
+            data_write_table.map(base, end, pointer, mask);
         }
+
+        map_tcm(base, end);
     }
 
     void unmap(u32 base, u32 end, RegionAttributes attributes) {
         if (attributes & RegionAttributes::Read) {
             read_table.unmap(base, end);
+            code_read_table.unmap(base, end);
+            data_read_table.unmap(base, end);
         }
 
         if (attributes & RegionAttributes::Write) {
             write_table.unmap(base, end);
+            code_write_table.unmap(base, end);
+            data_write_table.unmap(base, end);
         }
+
+        map_tcm(base, end);
+    }
+
+    // should be called whenever the tcm configuration changes
+    void update_tcm_mapping() {
+        // restore the pages that were previously covered by tcm
+        restore_pages(mapped_itcm.base, mapped_itcm.limit);
+        restore_pages(mapped_dtcm.base, mapped_dtcm.limit);
+
+        mapped_itcm = itcm.config;
+        mapped_dtcm = dtcm.config;
+        map_tcm(0, 0x100000000);
     }
 
     virtual u8 read_byte(u32 addr) = 0;
@@ -130,8 +168,88 @@ public:
     Coprocessor::TCM itcm;
     
 private:
-    common::PageTable<14> read_table;
-    common::PageTable<14> write_table;
+    using PageTable = common::PageTable<10>;
+
+    template <Bus B>
+    PageTable& get_read_table() {
+        if constexpr (B == Bus::Code) {
+            return code_read_table;
+        } else if constexpr (B == Bus::Data) {
+            return data_read_table;
+        } else {
+            return read_table;
+        }
+    }
+
+    template <Bus B>
+    PageTable& get_write_table() {
+        if constexpr (B == Bus::Code) {
+            return code_write_table;
+        } else if constexpr (B == Bus::Data) {
+            return data_write_table;
+        } else {
+            return write_table;
+        }
+    }
+
+    void restore_pages(u64 base, u64 end) {
+        for (u64 addr = base & ~PageTable::PAGE_MASK; addr < end; addr += PageTable::PAGE_SIZE) {
+            code_read_table.set_page(addr, read_table.get_page(addr));
+            code_write_table.set_page(addr, write_table.get_page(addr));
+            data_read_table.set_page(addr, read_table.get_page(addr));
+            data_write_table.set_page(addr, write_table.get_page(addr));
+        }
+    }
+
+    // overlays the tcm regions within base to end onto the code and data page tables
+    void map_tcm(u64 base, u64 end) {
+        // itcm is applied last since it has priority over dtcm
+        map_tcm(dtcm, base, end, false);
+        map_tcm(itcm, base, end, true);
+    }
+
+    void map_tcm(Coprocessor::TCM& tcm, u64 base, u64 end, bool code) {
+        if (!tcm.config.enable_writes) {
+            return;
+        }
+
+        u64 start = std::max<u64>(base, tcm.config.base);
+        u64 limit = std::min<u64>(end, tcm.config.limit);
+        for (u64 addr = start & ~PageTable::PAGE_MASK; addr < limit; addr += PageTable::PAGE_SIZE) {
+            // pages only partially covered by tcm are left to the slow path
+            u8* pointer = nullptr;
+            if (addr >= tcm.config.base && addr + PageTable::PAGE_SIZE <= tcm.config.limit) {
+                pointer = tcm.data + ((addr - tcm.config.base) & tcm.mask);
+            }
+
+            if (tcm.config.enable_reads) {
+                data_read_table.set_page(addr, pointer);
+                if (code) {
+                    code_read_table.set_page(addr, pointer);
+                }
+            }
+
+            data_write_table.set_page(addr, pointer);
+            if (code) {
+                code_write_table.set_page(addr, pointer);
+            }
+        }
+    }
+
+    // page tables for the system bus, which can't see tcm
+    PageTable read_table;
+    PageTable write_table;
+
+    // page tables for the code bus, which can see itcm
+    PageTable code_read_table;
+    PageTable code_write_table;
+
+    // page tables for the data bus, which can see both itcm and dtcm
+    PageTable data_read_table;
+    PageTable data_write_table;
+
+    Coprocessor::TCM::Config mapped_itcm;
+    Coprocessor::TCM::Config mapped_dtcm;
 };
 
-} // namespace arm
\ No newline at end of file
+} // namespace arm
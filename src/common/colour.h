@@ -0,0 +1,131 @@
+#pragma once
+
+#include <array>
+#include <type_traits>
+#include "common/types.h"
+#include "common/simd.h"
+
+namespace common {
+
+// colour format conversions shared between the gba and nds engines, the 3d renderer and display capture
+// each function works on a single u32 or on a whole vector of pixels at a time
+// rgb555: r in bits 0-4, g in bits 5-9, b in bits 10-14
+// rgb666: r in bits 0-5, g in bits 6-11, b in bits 12-17
+// rgb8888: r in bits 0-7, g in bits 8-15, b in bits 16-23, with an opaque alpha in bits 24-31
+
+template <int bits>
+constexpr std::array<u8, 1 << bits> build_expand_lut() {
+    constexpr int max = (1 << bits) - 1;
+    std::array<u8, 1 << bits> lut{};
+    for (int i = 0; i <= max; i++) {
+        lut[i] = (i * 255) / max;
+    }
+
+    return lut;
+}
+
+// expands 5-bit and 6-bit components to 8 bits, scaling so that the maximum value stays at 255
+constexpr auto expand_5bit_lut = build_expand_lut<5>();
+constexpr auto expand_6bit_lut = build_expand_lut<6>();
+
+// vectors can't index into a table, so they use a multiply and shift instead,
+// which give the same results as the tables without needing a division
+template <typename V>
+constexpr V expand_5bit(V c) {
+    return (c * 1053u) >> 7;
+}
+
+template <typename V>
+constexpr V expand_6bit(V c) {
+    return ((c * 259u) + 3u) >> 6;
+}
+
+template <std::size_t N>
+constexpr bool matches_lut(const std::array<u8, N>& lut, u32 (*expand)(u32)) {
+    for (u32 i = 0; i < lut.size(); i++) {
+        if (lut[i] != expand(i)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static_assert(matches_lut(expand_5bit_lut, expand_5bit<u32>));
+static_assert(matches_lut(expand_6bit_lut, expand_6bit<u32>));
+
+// x / 31 for x up to 31 * 31, which is what blending 5-bit components by a 5-bit factor needs
+template <typename V>
+V divide_by_31(V x) {
+    return (x * 2115u) >> 16;
+}
+
+template <typename V>
+V rgb555_to_rgb666(V colour) {
+    return ((colour & 0x1fu) << 1) | ((colour & 0x3e0u) << 2) | ((colour & 0x7c00u) << 3);
+}
+
+// drops the lowest bit of each component
+template <typename V>
+V rgb666_to_rgb555(V colour) {
+    return ((colour >> 1) & 0x1fu) | ((colour >> 2) & 0x3e0u) | ((colour >> 3) & 0x7c00u);
+}
+
+template <typename V>
+V rgb666_to_rgb8888(V colour) {
+    if constexpr (std::is_same_v<V, u32>) {
+        u32 r = expand_6bit_lut[colour & 0x3f];
+        u32 g = expand_6bit_lut[(colour >> 6) & 0x3f];
+        u32 b = expand_6bit_lut[(colour >> 12) & 0x3f];
+        return 0xff000000 | (b << 16) | (g << 8) | r;
+    } else {
+        V r = expand_6bit(colour & 0x3fu);
+        V g = expand_6bit((colour >> 6) & 0x3fu);
+        V b = expand_6bit((colour >> 12) & 0x3fu);
+        return 0xff000000u | (b << 16) | (g << 8) | r;
+    }
+}
+
+template <typename V>
+V rgb555_to_rgb8888(V colour) {
+    if constexpr (std::is_same_v<V, u32>) {
+        u32 r = expand_5bit_lut[colour & 0x1f];
+        u32 g = expand_5bit_lut[(colour >> 5) & 0x1f];
+        u32 b = expand_5bit_lut[(colour >> 10) & 0x1f];
+        return 0xff000000 | (b << 16) | (g << 8) | r;
+    } else {
+        V r = expand_5bit(colour & 0x1fu);
+        V g = expand_5bit((colour >> 5) & 0x1fu);
+        V b = expand_5bit((colour >> 10) & 0x1fu);
+        return 0xff000000u | (b << 16) | (g << 8) | r;
+    }
+}
+
+// converts count pixels from input into output, a vector at a time where that's faster
+template <typename In, typename Out, typename Convert>
+void convert_pixels(Out* output, const In* input, int count, Convert convert) {
+    int i = 0;
+    if constexpr (simd_accelerated) {
+        for (; i + lanes<u32x8>() <= count; i += lanes<u32x8>()) {
+            store(output + i, convert(load<u32x8>(input + i)));
+        }
+    }
+
+    for (; i < count; i++) {
+        output[i] = convert(static_cast<u32>(input[i]));
+    }
+}
+
+inline void convert_rgb555_to_rgb666(u32* output, const u16* input, int count) {
+    convert_pixels(output, input, count, [](auto colour) { return rgb555_to_rgb666(colour); });
+}
+
+inline void convert_rgb666_to_rgb8888(u32* output, const u32* input, int count) {
+    convert_pixels(output, input, count, [](auto colour) { return rgb666_to_rgb8888(colour); });
+}
+
+inline void convert_rgb555_to_rgb8888(u32* output, const u16* input, int count) {
+    convert_pixels(output, input, count, [](auto colour) { return rgb555_to_rgb8888(colour); });
+}
+
+} // namespace common
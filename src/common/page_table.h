@@ -1,6 +1,7 @@
 #pragma once
 
 #include <array>
+#include <memory>
 #include "common/types.h"
 
 namespace common {
@@ -44,7 +45,7 @@ public:
         for (u32 addr = base; addr < end; addr += PAGE_SIZE) {
             auto& l1_entry = page_table[get_l1_index(addr)];
             if (!l1_entry) {
-                return;
+                continue;
             }
 
             auto& l2_entry = (*l1_entry)[get_l2_index(addr)];
@@ -52,6 +53,33 @@ public:
         }
     }
 
+    // returns the pointer for the start of the page containing addr
+    u8* get_page(u32 addr) {
+        auto& l1_entry = page_table[get_l1_index(addr)];
+        if (!l1_entry) {
+            return nullptr;
+        }
+
+        return (*l1_entry)[get_l2_index(addr)];
+    }
+
+    // sets the pointer for a single page, where a nullptr unmaps the page
+    void set_page(u32 addr, u8* pointer) {
+        auto& l1_entry = page_table[get_l1_index(addr)];
+        if (!l1_entry) {
+            if (!pointer) {
+                return;
+            }
+
+            l1_entry = std::make_unique<std::array<L2Entry, L2_SIZE>>();
+        }
+
+        (*l1_entry)[get_l2_index(addr)] = pointer;
+    }
+
+    static constexpr int PAGE_SIZE = 1 << N;
+    static constexpr u32 PAGE_MASK = PAGE_SIZE - 1;
+
 private:
     int get_l1_index(u32 addr) {
         return addr >> L1_SHIFT;
@@ -61,8 +89,6 @@ private:
         return (addr >> L2_SHIFT) & L2_MASK;
     }
 
-    static constexpr int PAGE_SIZE = 1 << N;
-    static constexpr u32 PAGE_MASK = PAGE_SIZE - 1;
     static constexpr int L1_BITS = (32 - N) / 2;
     static constexpr int L1_SHIFT = 32 - L1_BITS;
     static constexpr int L1_SIZE = 1 << L1_BITS;
@@ -0,0 +1,314 @@
+#pragma once
+
+#include <cstring>
+#include <type_traits>
+#include "common/types.h"
+
+namespace common {
+
+// fixed width integer vectors for data parallel loops
+// with gcc and clang these use the vector extensions, which get lowered to sse / avx on x86
+// and neon on arm64, otherwise we fall back to a plain array with the same interface
+// comparisons produce a vector of the same type with each lane set to all ones or all zeroes
+
+// on baseline x86-64 (sse2) a lot of 32-bit vector operations have to be emulated,
+// so vector code paths should only be preferred when the target has avx2 or neon
+#if defined(__AVX2__) || defined(__ARM_NEON)
+constexpr bool simd_accelerated = true;
+#else
+constexpr bool simd_accelerated = false;
+#endif
+
+// only avx2 has a 32-bit to 64-bit vector multiply, elsewhere 64-bit lanes get multiplied one at a time
+#if defined(__AVX2__)
+constexpr bool simd_wide_multiply = true;
+#else
+constexpr bool simd_wide_multiply = false;
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+
+#if !defined(__clang__)
+// these vectors are only passed between inline functions, so the abi change doesn't matter
+#pragma GCC diagnostic ignored "-Wpsabi"
+#endif
+
+using u32x8 = u32 __attribute__((vector_size(32)));
+using s32x8 = s32 __attribute__((vector_size(32)));
+using s64x4 = s64 __attribute__((vector_size(32)));
+using s32x4 = s32 __attribute__((vector_size(16)));
+
+// x86 has no unsigned 32-bit comparisons before avx-512, so flip the sign bit and compare as signed instead
+// to stop the compiler from falling back to comparing each lane separately
+inline u32x8 less_than(u32x8 a, u32x8 b) {
+    return (u32x8)((s32x8)(a ^ 0x80000000) < (s32x8)(b ^ 0x80000000));
+}
+
+inline u32x8 equal(u32x8 a, u32x8 b) {
+    return (u32x8)(a == b);
+}
+
+// there's no vector integer division, but dividing two 32-bit values as doubles always truncates
+// to the exact integer quotient, since the rounding error is smaller than 1 / denominator
+// lanes where the denominator is 0 give 0
+inline u32x8 divide(u32x8 numerator, u32x8 denominator) {
+    using f64x8 = f64 __attribute__((vector_size(64)));
+    f64x8 quotient = __builtin_convertvector(numerator, f64x8) / __builtin_convertvector(denominator | (u32x8)(denominator == 0), f64x8);
+    return __builtin_convertvector(quotient, u32x8) & (u32x8)(denominator != 0);
+}
+
+// sign extends 4 32-bit values into 64-bit lanes
+inline s64x4 load_wide(const s32* data) {
+    s32x4 narrow;
+    std::memcpy(&narrow, data, sizeof(narrow));
+    return __builtin_convertvector(narrow, s64x4);
+}
+
+// multiplies lanes which hold sign extended 32-bit values
+inline s64x4 multiply_wide(s64x4 a, s64x4 b) {
+#if defined(__AVX2__)
+    return (s64x4)__builtin_ia32_pmuldq256((s32x8)a, (s32x8)b);
+#else
+    return a * b;
+#endif
+}
+
+#else
+
+template <typename T, int N>
+struct Vector {
+    T data[N];
+
+    T& operator[](int i) { return data[i]; }
+    const T& operator[](int i) const { return data[i]; }
+
+    Vector operator~() const {
+        Vector result;
+        for (int i = 0; i < N; i++) {
+            result.data[i] = ~data[i];
+        }
+
+        return result;
+    }
+};
+
+#define SIMD_BINARY_OPERATOR(op, expression) \
+    template <typename T, int N> \
+    Vector<T, N> operator op(const Vector<T, N>& a, const Vector<T, N>& b) { \
+        Vector<T, N> result; \
+        for (int i = 0; i < N; i++) { \
+            result.data[i] = expression; \
+        } \
+        return result; \
+    } \
+    template <typename T, int N> \
+    Vector<T, N> operator op(const Vector<T, N>& a, std::type_identity_t<T> scalar) { \
+        Vector<T, N> b; \
+        for (int i = 0; i < N; i++) { \
+            b.data[i] = scalar; \
+        } \
+        return a op b; \
+    } \
+    template <typename T, int N> \
+    Vector<T, N> operator op(std::type_identity_t<T> scalar, const Vector<T, N>& b) { \
+        Vector<T, N> a; \
+        for (int i = 0; i < N; i++) { \
+            a.data[i] = scalar; \
+        } \
+        return a op b; \
+    }
+
+#define SIMD_COMPOUND_OPERATOR(op) \
+    template <typename T, int N> \
+    Vector<T, N>& operator op##=(Vector<T, N>& a, const Vector<T, N>& b) { \
+        a = a op b; \
+        return a; \
+    }
+
+SIMD_BINARY_OPERATOR(+, a.data[i] + b.data[i])
+SIMD_BINARY_OPERATOR(-, a.data[i] - b.data[i])
+SIMD_BINARY_OPERATOR(*, a.data[i] * b.data[i])
+SIMD_BINARY_OPERATOR(/, a.data[i] / b.data[i])
+SIMD_BINARY_OPERATOR(&, a.data[i] & b.data[i])
+SIMD_BINARY_OPERATOR(|, a.data[i] | b.data[i])
+SIMD_BINARY_OPERATOR(^, a.data[i] ^ b.data[i])
+SIMD_BINARY_OPERATOR(<<, a.data[i] << b.data[i])
+SIMD_BINARY_OPERATOR(>>, a.data[i] >> b.data[i])
+SIMD_BINARY_OPERATOR(==, a.data[i] == b.data[i] ? static_cast<T>(~T{0}) : T{0})
+SIMD_BINARY_OPERATOR(!=, a.data[i] != b.data[i] ? static_cast<T>(~T{0}) : T{0})
+SIMD_BINARY_OPERATOR(<, a.data[i] < b.data[i] ? static_cast<T>(~T{0}) : T{0})
+SIMD_BINARY_OPERATOR(<=, a.data[i] <= b.data[i] ? static_cast<T>(~T{0}) : T{0})
+SIMD_BINARY_OPERATOR(>, a.data[i] > b.data[i] ? static_cast<T>(~T{0}) : T{0})
+SIMD_BINARY_OPERATOR(>=, a.data[i] >= b.data[i] ? static_cast<T>(~T{0}) : T{0})
+
+SIMD_COMPOUND_OPERATOR(+)
+SIMD_COMPOUND_OPERATOR(-)
+SIMD_COMPOUND_OPERATOR(*)
+SIMD_COMPOUND_OPERATOR(/)
+SIMD_COMPOUND_OPERATOR(&)
+SIMD_COMPOUND_OPERATOR(|)
+SIMD_COMPOUND_OPERATOR(^)
+SIMD_COMPOUND_OPERATOR(<<)
+SIMD_COMPOUND_OPERATOR(>>)
+
+#undef SIMD_BINARY_OPERATOR
+#undef SIMD_COMPOUND_OPERATOR
+
+using u32x8 = Vector<u32, 8>;
+using s64x4 = Vector<s64, 4>;
+
+inline u32x8 less_than(u32x8 a, u32x8 b) {
+    return a < b;
+}
+
+inline u32x8 equal(u32x8 a, u32x8 b) {
+    return a == b;
+}
+
+inline s64x4 load_wide(const s32* data) {
+    s64x4 result;
+    for (int i = 0; i < 4; i++) {
+        result[i] = data[i];
+    }
+
+    return result;
+}
+
+inline s64x4 multiply_wide(s64x4 a, s64x4 b) {
+    return a * b;
+}
+
+inline u32x8 divide(u32x8 numerator, u32x8 denominator) {
+    u32x8 result;
+    for (int i = 0; i < 8; i++) {
+        result[i] = denominator[i] == 0 ? 0 : numerator[i] / denominator[i];
+    }
+
+    return result;
+}
+
+#endif
+
+// the helpers below also accept plain integers, which act like a vector with a single lane,
+// so the same code can be shared between scalar and vector paths
+inline u32 less_than(u32 a, u32 b) {
+    return a < b ? 0xffffffff : 0;
+}
+
+inline u32 equal(u32 a, u32 b) {
+    return a == b ? 0xffffffff : 0;
+}
+
+template <typename V>
+constexpr int lanes() {
+    if constexpr (std::is_arithmetic_v<V>) {
+        return 1;
+    } else {
+        return sizeof(V) / sizeof(V{}[0]);
+    }
+}
+
+template <typename V, typename T>
+V splat(T value) {
+    if constexpr (std::is_arithmetic_v<V>) {
+        return static_cast<V>(value);
+    } else {
+        V result{};
+        return result + static_cast<std::remove_cvref_t<decltype(result[0])>>(value);
+    }
+}
+
+// picks lanes from a where mask is set and from b otherwise
+template <typename V, typename M>
+V select(M mask, V a, V b) {
+    if constexpr (std::is_arithmetic_v<V>) {
+        return mask ? a : b;
+    } else {
+        V m = (V)mask;
+        return (a & m) | (b & ~m);
+    }
+}
+
+template <typename V>
+V min(V a, V b) {
+    return select(less_than(a, b), a, b);
+}
+
+template <typename V>
+V max(V a, V b) {
+    return select(less_than(a, b), b, a);
+}
+
+// returns true if any lane of the mask is set, so work can be skipped when no lanes need it
+template <typename V>
+bool any(V mask) {
+    if constexpr (std::is_arithmetic_v<V>) {
+        return mask != 0;
+    } else {
+        V none{};
+        return std::memcmp(&mask, &none, sizeof(V)) != 0;
+    }
+}
+
+// applies a scalar function to each lane, for things like table lookups which can't be vectorised
+template <typename V, typename Function, typename... Args>
+V transform(Function function, V value, Args... args) {
+    if constexpr (std::is_arithmetic_v<V>) {
+        return function(value, args...);
+    } else {
+        V result{};
+        for (int i = 0; i < lanes<V>(); i++) {
+            result[i] = function(value[i], args[i]...);
+        }
+
+        return result;
+    }
+}
+
+// loads the first count lanes from memory, leaving the rest as 0
+// when T is narrower than a lane then each element gets zero extended
+template <typename V, typename T>
+V load(const T* data, int count = lanes<V>()) {
+    if constexpr (std::is_arithmetic_v<V>) {
+        return data[0];
+    } else {
+        V result{};
+#if defined(__GNUC__) || defined(__clang__)
+        // widen a whole vector of narrower elements at once, which maps to a single zero extending load
+        if constexpr (sizeof(T) < sizeof(result[0])) {
+            if (count == lanes<V>()) {
+                typedef T Narrow __attribute__((vector_size(sizeof(T) * lanes<V>())));
+                Narrow narrow;
+                std::memcpy(&narrow, data, sizeof(narrow));
+                return __builtin_convertvector(narrow, V);
+            }
+        }
+#endif
+
+        if (sizeof(T) == sizeof(result[0]) && count == lanes<V>()) {
+            std::memcpy(&result, data, sizeof(V));
+        } else {
+            for (int i = 0; i < count; i++) {
+                result[i] = data[i];
+            }
+        }
+
+        return result;
+    }
+}
+
+// stores the first count lanes to memory
+template <typename V, typename T>
+void store(T* data, V value, int count = lanes<V>()) {
+    if constexpr (std::is_arithmetic_v<V>) {
+        data[0] = value;
+    } else if (sizeof(T) == sizeof(value[0]) && count == lanes<V>()) {
+        std::memcpy(data, &value, sizeof(V));
+    } else {
+        for (int i = 0; i < count; i++) {
+            data[i] = value[i];
+        }
+    }
+}
+
+} // namespace common
@@ -3,6 +3,8 @@
 
 namespace common {
 
+std::atomic<u64> System::presented_frame_number{0};
+
 void System::set_game_path(const std::string& game_path) {
     config.game_path = game_path;
 }
@@ -17,6 +19,7 @@ void System::set_state(State new_state) {
         stop();
         if (state == State::Idle) {
             frames = 0;
+            skipped_frames = 0;
             reset();
         }
 
@@ -41,6 +44,57 @@ void System::toggle_framelimiter() {
     }
 }
 
+void System::set_frameskip(int frameskip) {
+    if (state == State::Running) {
+        set_state(State::Paused);
+        this->frameskip = frameskip;
+        skipped_frames = 0;
+        set_state(State::Running);
+    } else {
+        this->frameskip = frameskip;
+        skipped_frames = 0;
+    }
+}
+
+bool System::should_skip_frame() {
+    if (skipped_frames < frameskip) {
+        skipped_frames++;
+        return true;
+    }
+
+    skipped_frames = 0;
+    return false;
+}
+
+std::vector<u32*> System::fetch_framebuffers() {
+    auto& frame = output_frames.get_read_buffer();
+    std::vector<u32*> framebuffers;
+    for (int i = 0; i < num_screens; i++) {
+        framebuffers.push_back(frame.pixels.data() + (i * screen_size));
+    }
+
+    fetched_frame_number = frame.number;
+
+    return framebuffers;
+}
+
+u32* System::get_output_framebuffer(int screen) {
+    return output_frames.get_write_buffer().pixels.data() + (screen * screen_size);
+}
+
+void System::present_frame() {
+    output_frames.get_write_buffer().number = ++presented_frame_number;
+    output_frames.publish();
+}
+
+void System::configure_framebuffers(int num_screens, int width, int height) {
+    this->num_screens = num_screens;
+    screen_size = width * height;
+    for (auto& frame : output_frames.get_buffers()) {
+        frame.pixels.assign(num_screens * screen_size, 0xff000000);
+    }
+}
+
 void System::stop() {
     if (thread_state == ThreadState::Idle) {
         return;
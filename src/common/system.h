@@ -1,6 +1,7 @@
 #pragma once
 
 #include <thread>
+#include <atomic>
 #include <array>
 #include <chrono>
 #include <ratio>
@@ -10,6 +11,7 @@
 #include "common/config.h"
 #include "common/audio_device.h"
 #include "common/callback.h"
+#include "common/triple_buffer.h"
 
 namespace common {
 
@@ -19,7 +21,14 @@ public:
     virtual void reset() = 0;
     virtual void run_frame() = 0;
     virtual void set_audio_device(std::shared_ptr<common::AudioDevice> audio_device) = 0;
-    virtual std::vector<u32*> fetch_framebuffers() = 0;
+
+    // returns the most recently completed frame, with a pointer for each screen
+    // these stay valid until the next call
+    std::vector<u32*> fetch_framebuffers();
+
+    // the number of the frame returned by the last call to fetch_framebuffers,
+    // which only changes when a new frame has been presented
+    u64 get_fetched_frame_number() const { return fetched_frame_number; }
 
     BootMode get_boot_mode() const { return config.boot_mode; }
 
@@ -41,6 +50,17 @@ public:
 
     void set_state(State new_state);
     void toggle_framelimiter();
+    void set_frameskip(int frameskip);
+
+    // called by the video hardware at the start of each frame to decide
+    // whether pixels should be produced for it
+    bool should_skip_frame();
+
+    // used by the video hardware to write out a frame, which gets handed over to the frontend
+    // once it's complete
+    u32* get_output_framebuffer(int screen);
+    void present_frame();
+
     void stop();
     void pause();
     void resume();
@@ -49,6 +69,10 @@ public:
     std::shared_ptr<common::AudioDevice> audio_device;
     int frames{0};
     bool framelimiter{true};
+    int frameskip{0};
+
+protected:
+    void configure_framebuffers(int num_screens, int width, int height);
 
 private:
     void run_thread();
@@ -67,6 +91,20 @@ private:
     using Frame = std::chrono::duration<int, std::ratio<1, 60>>;
 
     UpdateCallback update_callback;
+    int skipped_frames{0};
+
+    struct OutputFrame {
+        u64 number{0};
+        std::vector<u32> pixels;
+    };
+
+    TripleBuffer<OutputFrame> output_frames;
+    u64 fetched_frame_number{0};
+    int screen_size{0};
+    int num_screens{0};
+
+    // shared between all systems, so a frame number is never reused after switching systems
+    static std::atomic<u64> presented_frame_number;
 
     static constexpr int FPS_UPDATE_INTERVAL = 500;
 };
@@ -0,0 +1,90 @@
+#include <algorithm>
+#include "common/thread_pool.h"
+
+namespace common {
+
+ThreadPool::ThreadPool() : ThreadPool(std::max(static_cast<int>(std::thread::hardware_concurrency()) - 1, 0)) {}
+
+ThreadPool::ThreadPool(int num_workers) {
+    for (int i = 0; i < num_workers; i++) {
+        workers.emplace_back([this]() {
+            run_worker();
+        });
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard lock{mutex};
+        running = false;
+    }
+
+    task_available.notify_all();
+
+    for (auto& worker : workers) {
+        worker.join();
+    }
+}
+
+void ThreadPool::run(int num_tasks, const Task& task) {
+    if (num_tasks <= 0) {
+        return;
+    }
+
+    std::unique_lock lock{mutex};
+    Job job;
+    job.task = &task;
+    job.num_tasks = num_tasks;
+    job.remaining_tasks = num_tasks;
+    jobs.push_back(&job);
+
+    // the caller runs tasks as well, so only wake up the workers which can get one
+    for (int i = 0; i < num_tasks - 1; i++) {
+        task_available.notify_one();
+    }
+
+    while (run_next_task(job, lock)) {}
+
+    tasks_finished.wait(lock, [&job]() {
+        return job.remaining_tasks == 0;
+    });
+}
+
+void ThreadPool::run_worker() {
+    std::unique_lock lock{mutex};
+    while (true) {
+        task_available.wait(lock, [this]() {
+            return !running || !jobs.empty();
+        });
+
+        if (!running) {
+            return;
+        }
+
+        // prefer the most recent job, since its caller is most likely to be waiting on a short piece of work
+        run_next_task(*jobs.back(), lock);
+    }
+}
+
+bool ThreadPool::run_next_task(Job& job, std::unique_lock<std::mutex>& lock) {
+    if (job.next_task >= job.num_tasks) {
+        return false;
+    }
+
+    int index = job.next_task++;
+    if (job.next_task == job.num_tasks) {
+        jobs.erase(std::find(jobs.begin(), jobs.end(), &job));
+    }
+
+    lock.unlock();
+    (*job.task)(index);
+    lock.lock();
+
+    if (--job.remaining_tasks == 0) {
+        tasks_finished.notify_all();
+    }
+
+    return true;
+}
+
+} // namespace common
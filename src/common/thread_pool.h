@@ -0,0 +1,51 @@
+#pragma once
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <vector>
+#include "common/types.h"
+
+namespace common {
+
+// a fixed set of worker threads used to split up work inside of a frame
+// the calling thread also takes part in running tasks, so a pool with 0 workers
+// behaves the same as running everything on the calling thread
+class ThreadPool {
+public:
+    ThreadPool();
+    ThreadPool(int num_workers);
+    ~ThreadPool();
+
+    using Task = std::function<void(int)>;
+
+    // runs task(i) for each i in [0, num_tasks) and blocks until they've all finished
+    // this can be called from several threads at once, for example the 3d render thread
+    // and the emulation thread, in which case the workers are shared between the callers
+    void run(int num_tasks, const Task& task);
+
+    int get_num_threads() const { return workers.size() + 1; }
+
+private:
+    struct Job {
+        const Task* task{nullptr};
+        int num_tasks{0};
+        int next_task{0};
+        int remaining_tasks{0};
+    };
+
+    void run_worker();
+    bool run_next_task(Job& job, std::unique_lock<std::mutex>& lock);
+
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable task_available;
+    std::condition_variable tasks_finished;
+
+    // jobs which still have tasks that haven't been started
+    std::vector<Job*> jobs;
+    bool running{true};
+};
+
+} // namespace common
@@ -0,0 +1,54 @@
+#pragma once
+
+#include "common/types.h"
+#include "common/memory.h"
+
+namespace common {
+
+// kernels for expanding rows of 2d tile data into colours, shared between the gba and nds engines
+// palettes are looked up through tables where every colour which is transparent
+// (index 0 of each palette) has already been replaced, so each pixel is a single load
+// with no branches
+
+// builds the table for 4bpp tiles, which holds 16 palettes of 16 colours
+inline void build_palette_lut_4bpp(u16* lut, u8* palette_ram, u16 transparent) {
+    for (int i = 0; i < 256; i++) {
+        lut[i] = (i & 0xf) == 0 ? transparent : common::read<u16>(palette_ram, i * 2);
+    }
+}
+
+// builds the table for a 256 colour palette used by 8bpp tiles
+inline void build_palette_lut_8bpp(u16* lut, u8* palette, u16 transparent) {
+    lut[0] = transparent;
+    for (int i = 1; i < 256; i++) {
+        lut[i] = common::read<u16>(palette, i * 2);
+    }
+}
+
+// expands the 8 4-bit indices of a tile row using one of the 16 colour palettes in the table
+inline void decode_tile_row_4bpp(u16* pixels, u32 indices, const u16* palette, bool horizontal_flip) {
+    if (horizontal_flip) {
+        for (int x = 0; x < 8; x++) {
+            pixels[7 - x] = palette[(indices >> (x * 4)) & 0xf];
+        }
+    } else {
+        for (int x = 0; x < 8; x++) {
+            pixels[x] = palette[(indices >> (x * 4)) & 0xf];
+        }
+    }
+}
+
+// expands the 8 8-bit indices of a tile row using a 256 colour palette
+inline void decode_tile_row_8bpp(u16* pixels, u64 indices, const u16* palette, bool horizontal_flip) {
+    if (horizontal_flip) {
+        for (int x = 0; x < 8; x++) {
+            pixels[7 - x] = palette[(indices >> (x * 8)) & 0xff];
+        }
+    } else {
+        for (int x = 0; x < 8; x++) {
+            pixels[x] = palette[(indices >> (x * 8)) & 0xff];
+        }
+    }
+}
+
+} // namespace common
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include "common/types.h"
+
+namespace common {
+
+// passes data from a single producer to a single consumer without either side blocking
+// the producer always has a buffer to write to, and the consumer always gets the
+// most recently published buffer, which stays untouched until it's read again
+template <typename T>
+class TripleBuffer {
+public:
+    T& get_write_buffer() {
+        return buffers[write_index];
+    }
+
+    // swaps the write buffer with the spare one and marks it as new
+    void publish() {
+        write_index = spare.exchange(write_index | new_bit, std::memory_order_acq_rel) & index_mask;
+    }
+
+    // takes the spare buffer if something newer was published since the last read
+    T& get_read_buffer() {
+        if (spare.load(std::memory_order_relaxed) & new_bit) {
+            read_index = spare.exchange(read_index, std::memory_order_acq_rel) & index_mask;
+        }
+
+        return buffers[read_index];
+    }
+
+    // only safe to use while neither side is accessing the buffers
+    std::array<T, 3>& get_buffers() {
+        return buffers;
+    }
+
+private:
+    static constexpr u8 index_mask = 0x3;
+    static constexpr u8 new_bit = 0x4;
+
+    std::array<T, 3> buffers;
+    u8 write_index{0};
+    std::atomic<u8> spare{1};
+    u8 read_index{2};
+};
+
+} // namespace common
@@ -121,7 +121,7 @@ void Application::render_gba() {
     auto framebuffers = system->fetch_framebuffers();
     assert(framebuffers.size() == 1);
 
-    main_screen.update_texture(framebuffers[0]);
+    main_screen.update_texture(framebuffers[0], system->get_fetched_frame_number());
     
     const f64 scale_x = static_cast<f64>(window_width) / 240;
     const f64 scale_y = static_cast<f64>(window_height) / 160;
@@ -149,8 +149,8 @@ void Application::render_nds() {
     auto framebuffers = system->fetch_framebuffers();
     assert(framebuffers.size() == 2);
 
-    top_screen.update_texture(framebuffers[0]);
-    bottom_screen.update_texture(framebuffers[1]);
+    top_screen.update_texture(framebuffers[0], system->get_fetched_frame_number());
+    bottom_screen.update_texture(framebuffers[1], system->get_fetched_frame_number());
 
     const f64 scale_x = static_cast<f64>(window_width) / 256;
     const f64 scale_y = static_cast<f64>(window_height) / 384;
@@ -215,6 +215,17 @@ void Application::render_menubar() {
                 ImGui::MenuItem("Enable Framelimiter", nullptr, false, false);
             }
 
+            if (ImGui::BeginMenu("Frameskip", system != nullptr)) {
+                for (int i = 0; i <= 4; i++) {
+                    auto label = i == 0 ? std::string{"Off"} : std::to_string(i);
+                    if (ImGui::MenuItem(label.c_str(), nullptr, system->frameskip == i, true)) {
+                        system->set_frameskip(i);
+                    }
+                }
+
+                ImGui::EndMenu();
+            }
+
             if (ImGui::MenuItem("Restart", nullptr, false, system != nullptr)) {
                 system->set_state(common::System::State::Idle);
                 switch_screen(ScreenType::Game);
@@ -2,15 +2,34 @@
 
 void ImGuiVideoDevice::update_texture(u32* pointer) {
     glBindTexture(GL_TEXTURE_2D, texture);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, pointer);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, pointer);
+}
+
+void ImGuiVideoDevice::update_texture(u32* pointer, u64 frame_number) {
+    if (frame_number == uploaded_frame_number) {
+        return;
+    }
+
+    update_texture(pointer);
+    uploaded_frame_number = frame_number;
 }
 
 void ImGuiVideoDevice::destroy() {
     glDeleteTextures(1, &texture);
+    texture = 0;
+    uploaded_frame_number = std::numeric_limits<u64>::max();
 }
 
 void ImGuiVideoDevice::configure(int width, int height, Filter filter) {
-    glGenTextures(1, &texture);
+    // the texture only needs to be created again when its size or filter changes
+    if (texture != 0 && width == this->width && height == this->height && filter == this->filter) {
+        return;
+    }
+
+    if (texture == 0) {
+        glGenTextures(1, &texture);
+    }
+
     glBindTexture(GL_TEXTURE_2D, texture);
 
     switch (filter) {
@@ -27,6 +46,11 @@ void ImGuiVideoDevice::configure(int width, int height, Filter filter) {
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
 
+    // allocate the storage once, so each frame only has to copy pixels into it
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+
     this->width = width;
     this->height = height;
-}
\ No newline at end of file
+    this->filter = filter;
+    uploaded_frame_number = std::numeric_limits<u64>::max();
+}
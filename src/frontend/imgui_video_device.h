@@ -2,6 +2,7 @@
 
 #include <SDL_opengl.h>
 #include <array>
+#include <limits>
 #include "common/types.h"
 #include "common/video_device.h"
 
@@ -16,10 +17,15 @@ public:
     void destroy() override;
     void configure(int width, int height, Filter filter);
 
+    // only uploads the frame if it's different to the one uploaded last time
+    void update_texture(u32* pointer, u64 frame_number);
+
     GLuint get_texture() { return texture; }
     
 private:
-    GLuint texture;
-    int width;
-    int height;
-};
\ No newline at end of file
+    GLuint texture{0};
+    int width{0};
+    int height{0};
+    Filter filter{Filter::Nearest};
+    u64 uploaded_frame_number{std::numeric_limits<u64>::max()};
+};
@@ -21,12 +21,30 @@ void Memory::reset() {
     map(0x02000000, 0x03000000, ewram.data(), 0x3ffff, arm::RegionAttributes::ReadWrite);
     map(0x03000000, 0x04000000, iwram.data(), 0x7fff, arm::RegionAttributes::ReadWrite);
 
+    // video memory writes stay on the slow path, since 8-bit writes have special behaviour
+    map(0x05000000, 0x06000000, system.ppu.get_palette_ram(), 0x3ff, arm::RegionAttributes::Read);
+    map(0x07000000, 0x08000000, system.ppu.get_oam(), 0x3ff, arm::RegionAttributes::Read);
+    map_vram();
+
     // TODO: how does the rom get mirrored if it's < 32mb?
     map(0x08000000, 0x0a000000, system.cartridge.get_rom_pointer(), 0x1ffffff, arm::RegionAttributes::Read);
     map(0x0a000000, 0x0c000000, system.cartridge.get_rom_pointer(), 0x1ffffff, arm::RegionAttributes::Read);
     map(0x0c000000, 0x0e000000, system.cartridge.get_rom_pointer(), 0x1ffffff, arm::RegionAttributes::Read);
 }
 
+void Memory::map_vram() {
+    // 0x00000 - 0x17fff is mapped directly
+    // 0x18000 - 0x1ffff is mapped to 0x10000 - 0x17fff
+    for (u32 addr = 0x06000000; addr < 0x07000000; addr += 0x400) {
+        u32 offset = addr & 0x1ffff;
+        if (offset >= 0x18000) {
+            offset -= 0x8000;
+        }
+
+        map(addr, addr + 0x400, system.ppu.vram.data() + offset, 0x3ff, arm::RegionAttributes::Read);
+    }
+}
+
 u8 Memory::read_byte(u32 addr) {
     switch (addr >> 24) {
     case 0x04:
@@ -68,7 +86,7 @@ u32 Memory::read_word(u32 addr) {
     case 0x05:
         return system.ppu.read_palette_ram<u32>(addr);
     case 0x06:
-        return system.ppu.read_vram<u16>(addr);
+        return system.ppu.read_vram<u32>(addr);
     case 0x07:
         return system.ppu.read_oam<u32>(addr);
     default:
@@ -40,6 +40,7 @@ private:
     int get_access_size(u32 mask);
     u32 get_access_offset(u32 mask);
 
+    void map_vram();
     void load_bios(const std::string& path);
 
     void write_haltcnt(u8 value);
@@ -7,6 +7,8 @@
 namespace gba {
 
 System::System() : memory(*this), ppu(*this), irq(cpu), timers(scheduler, irq), dma(scheduler, memory, irq) {
+    configure_framebuffers(1, 240, 160);
+
     arm::Config config;
     config.block_size = 1;
     config.backend_type = arm::BackendType::Interpreter;
@@ -70,10 +72,6 @@ void System::configure_cpu_backend(arm::Config config) {
     }
 }
 
-std::vector<u32*> System::fetch_framebuffers() {
-    return {ppu.fetch_framebuffer()};
-}
-
 void System::skip_bios() {
     // enter system mode
     auto cpsr = cpu->get_cpsr();
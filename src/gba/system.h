@@ -27,7 +27,6 @@ public:
     void reset() override;
     void run_frame() override;
     void set_audio_device(std::shared_ptr<common::AudioDevice> audio_device) override;
-    std::vector<u32*> fetch_framebuffers() override;
     void configure_cpu_backend(arm::Config config);
 
     Memory memory;
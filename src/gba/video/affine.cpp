@@ -4,6 +4,7 @@ namespace gba {
 
 void PPU::render_affine(int id) {
     LOG_WARN("render_affine %d", id);
+    bg_layers[id].fill(colour_transparent);
 }
 
 } // namespace gba
\ No newline at end of file
@@ -1,4 +1,6 @@
+#include <cstring>
 #include "common/memory.h"
+#include "common/tile_decoder.h"
 #include "common/bits.h"
 #include "gba/video/ppu.h"
 
@@ -23,9 +25,13 @@ void PPU::render_background(int id, int line) {
         }
     }
 
-    std::array<u16, 8> pixels;
-    for (int tile = 0; tile <= 240; tile += 8) {
-        int x = (tile + bghofs[id]) % 512;
+    update_bg_palettes();
+
+    // decode whole tiles into a tile aligned buffer, then copy out the visible part of the line
+    alignas(32) std::array<u16, 248> pixels;
+    int row = y % 8;
+    for (int tile = 0; tile < 31; tile++) {
+        int x = ((tile * 8) + bghofs[id]) % 512;
         u32 screen_addr = screen_base + ((x / 8) % 32) * 2;
 
         if (x >= 256 && screen_width == 512) {
@@ -34,25 +40,21 @@ void PPU::render_background(int id, int line) {
 
         u16 tile_info = common::read<u16>(vram.data(), screen_addr);
         int tile_number = common::get_field<0, 10>(tile_info);
-        bool horizontal_flip = common::get_bit<10>(tile_info);;
+        bool horizontal_flip = common::get_bit<10>(tile_info);
         bool vertical_flip = common::get_bit<11>(tile_info);
         int palette_number = common::get_field<12, 4>(tile_info);
+        int tile_row = vertical_flip ? (row ^ 7) : row;
 
         if (bgcnt[id].palette_8bpp) {
-            pixels = decode_tile_row_8bpp(character_base, tile_number, y, horizontal_flip, vertical_flip);
+            u64 indices = common::read<u64>(vram.data(), character_base + (tile_number * 64) + (tile_row * 8));
+            common::decode_tile_row_8bpp(pixels.data() + (tile * 8), indices, bg_palette_8bpp.data(), horizontal_flip);
         } else {
-            pixels = decode_tile_row_4bpp(character_base, tile_number, palette_number, y, horizontal_flip, vertical_flip);
-        }
-
-        for (int j = 0; j < 8; j++) {
-            int offset = tile + j - (x % 8);
-            if (offset < 0 || offset >= 240) {
-                continue;
-            }
-
-            bg_layers[id][offset] = pixels[j];
+            u32 indices = common::read<u32>(vram.data(), character_base + (tile_number * 32) + (tile_row * 4));
+            common::decode_tile_row_4bpp(pixels.data() + (tile * 8), indices, bg_palette_4bpp.data() + (palette_number * 16), horizontal_flip);
         }
     }
+
+    std::memcpy(bg_layers[id].data(), pixels.data() + (bghofs[id] % 8), 240 * sizeof(u16));
 }
 
 } // namespace gba
\ No newline at end of file
@@ -1,37 +1,46 @@
+#include <algorithm>
+#include <cstring>
 #include "common/memory.h"
 #include "gba/video/ppu.h"
 
 namespace gba {
 
+// bitmap colours only use 15 bits, so bit 15 gets cleared to stop it being mistaken for transparency
 void PPU::render_mode3(int id, int line) {
+    auto& layer = bg_layers[id];
+    std::memcpy(layer.data(), vram.data() + (240 * line * 2), 240 * sizeof(u16));
+
     for (int x = 0; x < 240; x++) {
-        int offset = ((240 * line) + x) * 2;
-        bg_layers[id][x] = common::read<u16>(vram.data(), offset);
+        layer[x] &= 0x7fff;
     }
 }
 
 void PPU::render_mode4(int id, int line) {
-    auto bitmap_start = dispcnt.display_frame_select * 0xa000;
+    update_bg_palettes();
 
+    const u8* row = vram.data() + (dispcnt.display_frame_select * 0xa000) + (240 * line);
+    auto& layer = bg_layers[id];
     for (int x = 0; x < 240; x++) {
-        int offset = bitmap_start + (240 * line) + x;
-        int palette_index = vram[offset];
-        bg_layers[id][x] = common::read<u16>(palette_ram.data(), palette_index * 2);
+        layer[x] = bg_palette_8bpp[row[x]];
     }
 }
 
 void PPU::render_mode5(int id, int line) {
+    auto& layer = bg_layers[id];
+
     // the bitmap is only 160x128
     if (line >= 128) {
+        layer.fill(colour_transparent);
         return;
     }
 
-    auto bitmap_start = dispcnt.display_frame_select * 0xa000;
+    std::memcpy(layer.data(), vram.data() + (dispcnt.display_frame_select * 0xa000) + (160 * line * 2), 160 * sizeof(u16));
 
     for (int x = 0; x < 160; x++) {
-        int offset = bitmap_start + ((160 * line) + x) * 2;
-        bg_layers[id][x] = common::read<u16>(vram.data(), offset);
+        layer[x] &= 0x7fff;
     }
+
+    std::fill(layer.begin() + 160, layer.begin() + 240, colour_transparent);
 }
 
-} // namespace gba
\ No newline at end of file
+} // namespace gba
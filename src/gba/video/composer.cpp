@@ -1,37 +1,59 @@
 #include "common/memory.h"
+#include "common/simd.h"
+#include "common/colour.h"
 #include "gba/video/ppu.h"
 
 namespace gba {
 
 void PPU::compose_scanline(int line) {
-    for (int x = 0; x < 240; x++) {
-        compose_pixel(x, line);
+    calculate_window_mask(line);
+
+    if constexpr (common::simd_accelerated) {
+        for (int x = 0; x < 240; x += common::lanes<common::u32x8>()) {
+            compose_pixels<common::u32x8>(x, line);
+        }
+    } else {
+        for (int x = 0; x < 240; x++) {
+            compose_pixels<u32>(x, line);
+        }
     }
 }
 
-void PPU::compose_pixel(int x, int line) {
-    u8 enabled = calculate_enabled_layers(x, line);
-    u16 backdrop = common::read<u16>(palette_ram.data());
-    u16 pixel = backdrop;
-    int priority = 4;
+// composes lanes<V>() pixels starting at x by finding the top layer at each pixel
+template <typename V>
+void PPU::compose_pixels(int x, int line) {
+    using common::equal;
+    using common::less_than;
+    using common::select;
+    using common::splat;
+
+    const V zero = splat<V>(0);
+    const V transparent = splat<V>(colour_transparent);
+    const V window = common::load<V>(window_mask.data() + x);
+    V pixel = splat<V>(common::read<u16>(palette_ram.data()));
+    V priority = splat<V>(4);
 
+    // when priorities are equal the lower numbered background wins
     for (int i = 3; i >= 0; i--) {
-        if (((enabled >> i) & 0x1) && bgcnt[i].priority <= priority) {
-            u16 bg_pixel = bg_layers[i][x];
-            if (bg_pixel != colour_transparent) {
-                pixel = bg_pixel;
-                priority = bgcnt[i].priority;
-            }
+        if (!((enabled_bgs >> i) & 0x1)) {
+            continue;
         }
-    }
 
-    if (dispcnt.enable_obj && obj_buffer[x].colour != colour_transparent) {
-        if (obj_buffer[x].priority <= priority) {
-            pixel = obj_buffer[x].colour;
-        }
+        const V bg_pixel = common::load<V>(bg_layers[i].data() + x);
+        const V bg_priority = splat<V>(bgcnt[i].priority);
+        const V visible = ~equal(window & (1u << i), zero) & ~equal(bg_pixel, transparent) & ~less_than(priority, bg_priority);
+
+        pixel = select(visible, bg_pixel, pixel);
+        priority = select(visible, bg_priority, priority);
     }
 
-    plot(x, line, 0xff000000 | rgb555_to_rgb888(pixel));
+    // objects are drawn above backgrounds with the same priority
+    const V obj_pixel = common::load<V>(obj_colour.data() + x);
+    const V obj_pixel_priority = common::load<V>(obj_priority.data() + x);
+    const V obj_visible = ~equal(window & 0x10u, zero) & ~equal(obj_pixel, transparent) & ~less_than(priority, obj_pixel_priority);
+    pixel = select(obj_visible, obj_pixel, pixel);
+
+    common::store(framebuffer.data() + (240 * line) + x, common::rgb555_to_rgb8888(pixel));
 }
 
-} // namespace gba
\ No newline at end of file
+} // namespace gba
@@ -88,10 +88,6 @@ void PPU::render_objects(int line) {
             LOG_WARN("PPU: handle semi transparent objects");
         }
 
-        if (mode == ObjectMode::ObjectWindow) {
-            LOG_ERROR("PPU: handle object window mode");
-        }
-
         int local_y = line - y;
         if (local_y < -half_height || local_y >= half_height) {
             continue;
@@ -146,12 +142,19 @@ void PPU::render_objects(int line) {
                 colour = decode_obj_pixel_4bpp(tile_addr, palette_number, inner_tile_x, inner_tile_y);
             }
 
-            Object& target_obj = obj_buffer[global_x];
-            if (colour != colour_transparent) {
-                if (priority < target_obj.priority) {
-                    target_obj.colour = colour;
-                    target_obj.priority = priority;
-                }
+            if (colour == colour_transparent) {
+                continue;
+            }
+
+            // object window sprites aren't drawn, they only mark where the object window is
+            if (mode == ObjectMode::ObjectWindow) {
+                obj_window[global_x] = 1;
+                continue;
+            }
+
+            if (priority < obj_priority[global_x]) {
+                obj_colour[global_x] = colour;
+                obj_priority[global_x] = priority;
             }
         }
     }
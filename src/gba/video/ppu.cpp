@@ -1,10 +1,11 @@
+#include <algorithm>
 #include "common/bits.h"
 #include "gba/video/ppu.h"
 #include "gba/system.h"
 
 namespace gba {
 
-PPU::PPU(System& system) : scheduler(system.scheduler), irq(system.irq), dma(system.dma) {}
+PPU::PPU(System& system) : system(system), scheduler(system.scheduler), irq(system.irq), dma(system.dma) {}
 
 void PPU::reset() {
     vram.fill(0);
@@ -31,6 +32,7 @@ void PPU::reset() {
     bldcnt.data = 0;
     bldalpha.data = 0;
     bldy.data = 0;
+    skip_frame = false;
     framebuffer.fill(0xff000000);
     
     scanline_start_event = scheduler.register_event("Scanline Start", [this]() {
@@ -45,6 +47,7 @@ void PPU::reset() {
 
     scheduler.add_event(1004, &scanline_start_event);
 
+    bg_palettes_dirty = true;
     reset_layers();
 }
 
@@ -130,8 +133,17 @@ void PPU::write_bldy(u16 value, u32 mask) {
 }
 
 void PPU::render_scanline_start() {
+    if (vcount == 0) {
+        skip_frame = system.should_skip_frame();
+    }
+
     if (vcount < 160) {
-        render_scanline(vcount);
+        if (skip_frame) {
+            skip_scanline(vcount);
+        } else {
+            render_scanline(vcount);
+        }
+
         dma.trigger(DMA::Timing::HBlank);
     }
 
@@ -158,6 +170,12 @@ void PPU::render_scanline_end() {
         }
 
         dma.trigger(DMA::Timing::VBlank);
+
+        if (!skip_frame) {
+            std::copy(framebuffer.begin(), framebuffer.end(), system.get_output_framebuffer(0));
+            system.present_frame();
+        }
+
         break;
     case 228:
         dispstat.vblank = false;
@@ -179,77 +197,43 @@ void PPU::render_scanline(int line) {
     reset_layers();
 
     if (line == 0) {
-        internal_x[0] = bgx[0];
-        internal_y[0] = bgy[0];
-        internal_x[1] = bgx[1];
-        internal_y[1] = bgy[1];
+        reload_internal_registers();
     }
 
+    enabled_bgs = common::get_field<8, 4>(dispcnt.data) & mode_bgs[dispcnt.bg_mode];
+
     switch (dispcnt.bg_mode) {
     case 0:
-        if (dispcnt.enable_bg0) {
-            render_background(0, line);
-        }
-
-        if (dispcnt.enable_bg1) {
-            render_background(1, line);
-        }
-
-        if (dispcnt.enable_bg2) {
-            render_background(2, line);
-        }
-
-        if (dispcnt.enable_bg3) {
-            render_background(3, line);
-        }
-
-        break;
     case 1:
-        if (dispcnt.enable_bg0) {
-            render_background(0, line);
-        }
-
-        if (dispcnt.enable_bg1) {
-            render_background(1, line);
-        }
-
-        if (dispcnt.enable_bg2) {
-            render_affine(2);
-        }
-
-        break;
     case 2:
-        if (dispcnt.enable_bg0) {
-            render_background(0, line);
+        // bg2 and bg3 are affine in modes 1 and 2
+        for (int i = 0; i < 4; i++) {
+            if (!((enabled_bgs >> i) & 0x1)) {
+                continue;
+            }
+
+            if (i >= 2 && dispcnt.bg_mode != 0) {
+                render_affine(i);
+            } else {
+                render_background(i, line);
+            }
         }
 
-        if (dispcnt.enable_bg1) {
-            render_background(1, line);
-        }
-
-        if (dispcnt.enable_bg2) {
-            render_affine(2);
-        }
-
-        if (dispcnt.enable_bg3) {
-            render_affine(3);
-        }
-        
         break;
     case 3:
-        if (dispcnt.enable_bg2) {
+        if (enabled_bgs) {
             render_mode3(2, line);
         }
 
         break;
     case 4:
-        if (dispcnt.enable_bg2) {
+        if (enabled_bgs) {
             render_mode4(2, line);
         }
 
         break;
     case 5:
-        if (dispcnt.enable_bg2) {
+        if (enabled_bgs) {
             render_mode5(2, line);
         }
 
@@ -261,62 +245,81 @@ void PPU::render_scanline(int line) {
     }
 
     compose_scanline(line);
+    update_internal_registers();
+}
 
-    // update internal affine registers
+void PPU::skip_scanline(int line) {
+    // no pixels are produced, but the internal affine registers still need to advance
+    if (line == 0) {
+        reload_internal_registers();
+    }
+
+    update_internal_registers();
+}
+
+void PPU::reload_internal_registers() {
+    internal_x[0] = bgx[0];
+    internal_y[0] = bgy[0];
+    internal_x[1] = bgx[1];
+    internal_y[1] = bgy[1];
+}
+
+void PPU::update_internal_registers() {
     for (int i = 0; i < 2; i++) {
         internal_x[i] += bgpb[i];
         internal_y[i] += bgpd[i];
     }
 }
 
-u32 PPU::rgb555_to_rgb888(u32 colour) {
-    u8 r = ((colour & 0x1f) * 255) / 31;
-    u8 g = (((colour >> 5) & 0x1f) * 255) / 31;
-    u8 b = (((colour >> 10) & 0x1f) * 255) / 31;
-    return (b << 16) | (g << 8) | r;
-}
-
 void PPU::plot(int x, int y, u32 colour) {
     framebuffer[(240 * y) + x] = colour;
 }
 
+// enabled backgrounds write every pixel of their layer and disabled ones are skipped by the compositor,
+// so only the object layer needs to be cleared
 void PPU::reset_layers() {
-    for (int i = 0; i < 4; i++) {
-        bg_layers[i].fill(0);
+    obj_colour.fill(colour_transparent);
+    obj_priority.fill(4);
+    obj_window.fill(0);
+}
+
+void PPU::calculate_window_mask(int line) {
+    u8 enabled = common::get_field<8, 5>(dispcnt.data) | 0x20;
+    if (!dispcnt.enable_win0 && !dispcnt.enable_win1 && !dispcnt.enable_objwin) {
+        window_mask.fill(enabled);
+        return;
     }
 
-    for (int i = 0; i < 256; i++) {
-        obj_buffer[i].priority = 4;
-        obj_buffer[i].colour = colour_transparent;
+    // start with the area outside of every window, then layer the windows on top
+    // from lowest to highest priority
+    window_mask.fill(winout & enabled);
+
+    if (dispcnt.enable_objwin && dispcnt.enable_obj) {
+        u8 objwin = (winout >> 8) & enabled;
+        for (int x = 0; x < 240; x++) {
+            if (obj_window[x]) {
+                window_mask[x] = objwin;
+            }
+        }
     }
-}
 
-u8 PPU::calculate_enabled_layers(int x, int line) {
-    u8 enabled = common::get_field<8, 5>(dispcnt.data);
-    u8 window = common::get_field<13, 3>(dispcnt.data);
-
-    if (window) {
-        u8 win0_x1 = winh[0] >> 8;
-        u8 win0_x2 = winh[0] & 0xff;
-        u8 win0_y1 = winv[0] >> 8;
-        u8 win0_y2 = winv[0] & 0xff;
-        u8 win1_x1 = winh[1] >> 8;
-        u8 win1_x2 = winh[1] & 0xff;
-        u8 win1_y1 = winv[1] >> 8;
-        u8 win1_y2 = winv[1] & 0xff;
-
-        if (dispcnt.enable_win0 && in_window_bounds(x, win0_x1, win0_x2) && in_window_bounds(line, win0_y1, win0_y2)) {
-            enabled &= winin & 0xf;
-        } else if (dispcnt.enable_win1 && in_window_bounds(x, win1_x1, win1_x2) && in_window_bounds(line, win1_y1, win1_y2)) {
-            enabled &= (winin >> 8) & 0xf;
-        } else if (dispcnt.enable_objwin) {
-            // LOG_WARN("PPU: handle object window");
+    for (int i = 1; i >= 0; i--) {
+        bool enable = i == 0 ? dispcnt.enable_win0 : dispcnt.enable_win1;
+        if (!enable || !in_window_bounds(line, winv[i] >> 8, winv[i] & 0xff)) {
+            continue;
+        }
+
+        int x1 = winh[i] >> 8;
+        int x2 = winh[i] & 0xff;
+        u8 mask = (winin >> (i * 8)) & enabled;
+
+        if (x1 <= x2) {
+            std::fill(window_mask.begin() + x1, window_mask.begin() + x2, mask);
         } else {
-            enabled &= winout & 0xf;  
+            std::fill(window_mask.begin(), window_mask.begin() + x2, mask);
+            std::fill(window_mask.begin() + x1, window_mask.end(), mask);
         }
     }
-
-    return enabled;
 }
 
 bool PPU::in_window_bounds(int coord, int start, int end) {
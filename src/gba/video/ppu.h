@@ -22,7 +22,8 @@ public:
     u16 read_vcount() { return vcount; }
     u16 read_bgcnt(int id) { return bgcnt[id].data; }
 
-    u32* fetch_framebuffer() { return framebuffer.data(); }
+    u8* get_palette_ram() { return palette_ram.data(); }
+    u8* get_oam() { return oam.data(); }
 
     void write_dispcnt(u16 value, u32 mask);
     void write_dispstat(u16 value, u32 mask);
@@ -65,6 +66,8 @@ public:
         } else {
             common::write<T>(palette_ram.data(), value, addr & 0x3ff);
         }
+
+        bg_palettes_dirty = true;
     }
 
     template <typename T>
@@ -116,28 +119,32 @@ private:
     void render_scanline_start();
     void render_scanline_end();
     void render_scanline(int line);
+    void skip_scanline(int line);
+    void reload_internal_registers();
+    void update_internal_registers();
     void render_background(int id, int line);
     void render_affine(int id);
     void render_mode3(int id, int line);
     void render_mode4(int id, int line);
     void render_mode5(int id, int line);
     void render_objects(int line);
-    u32 rgb555_to_rgb888(u32 colour);
+
     void plot(int x, int y, u32 colour);
     void reset_layers();
 
     void compose_scanline(int line);
-    void compose_pixel(int x, int line);
 
-    u8 calculate_enabled_layers(int x, int line);
+    template <typename V>
+    void compose_pixels(int x, int line);
+
+    void calculate_window_mask(int line);
     bool in_window_bounds(int coord, int start, int end);
 
     using TileRow = std::array<u16, 8>;
 
     u16 decode_obj_pixel_4bpp(u32 base, int number, int x, int y);
     u16 decode_obj_pixel_8bpp(u32 base, int x, int y);
-    TileRow decode_tile_row_4bpp(u32 tile_base, int tile_number, int palette_number, int y, bool horizontal_flip, bool vertical_flip);
-    TileRow decode_tile_row_8bpp(u32 tile_base, int tile_number, int y, bool horizontal_flip, bool vertical_flip);
+    void update_bg_palettes();
 
     union DISPCNT {
         struct {
@@ -239,11 +246,6 @@ private:
         u32 data;
     };
 
-    struct Object {
-        int priority;
-        u16 colour;
-    };
-
     enum class ObjectMode : int {
         Normal = 0,
         SemiTransparent = 1,
@@ -277,8 +279,30 @@ private:
     std::array<u8, 0x400> oam;
 
     std::array<std::array<u16, 256>, 4> bg_layers;
-    std::array<Object, 256> obj_buffer;
 
+    // the backgrounds which are enabled and exist in the current mode
+    u8 enabled_bgs;
+
+    // palette lookup tables for background tiles, where colour 0 of each palette is already transparent
+    // the 4bpp table holds 16 palettes of 16 colours
+    std::array<u16, 256> bg_palette_4bpp;
+    std::array<u16, 256> bg_palette_8bpp;
+    bool bg_palettes_dirty;
+
+    // the object layer of the current scanline, split into separate arrays
+    // so the compositor can load several pixels at a time
+    std::array<u16, 256> obj_colour;
+    std::array<u8, 256> obj_priority;
+    std::array<u8, 256> obj_window;
+
+    // the layers which are visible at each pixel of the current scanline after applying the windows
+    // bits 0-3: bg0-3
+    // bit 4: obj
+    // bit 5: colour special effects
+    std::array<u8, 256> window_mask;
+    bool skip_frame{false};
+
+    System& system;
     common::Scheduler& scheduler;
     IRQ& irq;
     DMA& dma;
@@ -288,6 +312,7 @@ private:
 
     static constexpr int bg_dimentions[4][2] = {{256, 256}, {512, 256}, {256, 512}, {512, 512}};
     static constexpr int obj_dimensions[4][4][2] = {{{8, 8}, {16, 16}, {32, 32}, {64, 64}}, {{16, 8}, {32, 8}, {32, 16}, {64, 32}}, {{8, 16}, {8, 32}, {16, 32}, {32, 64}}, {{0, 0}, {0, 0}, {0, 0}, {0, 0}}};
+    static constexpr u8 mode_bgs[8] = {0xf, 0x7, 0xc, 0x4, 0x4, 0x4, 0x0, 0x0};
     static constexpr u16 colour_transparent = 0x8000;
     static constexpr u32 vram_obj_offset = 0x10000;
 };
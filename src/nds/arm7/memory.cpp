@@ -41,6 +41,20 @@ void ARM7Memory::update_wram_mapping() {
     map(0x03800000, 0x04000000, arm7_wram.data(), 0xffff, arm::RegionAttributes::ReadWrite);
 }
 
+void ARM7Memory::update_vram_mapping() {
+    // pages with a single bank mapped can be read directly, while unmapped
+    // and overlapping pages go through the slow path. writes always take the
+    // slow path so that vram writes can be tracked
+    for (u32 addr = 0x06000000; addr < 0x07000000; addr += 0x1000) {
+        auto pointer = system.video_unit.vram.arm7_vram.get_pointer(addr);
+        if (pointer) {
+            map(addr, addr + 0x1000, pointer, 0xfff, arm::RegionAttributes::Read);
+        } else {
+            unmap(addr, addr + 0x1000, arm::RegionAttributes::Read);
+        }
+    }
+}
+
 u8 ARM7Memory::read_byte(u32 addr) {
     switch (addr >> 24) {
     case 0x04:
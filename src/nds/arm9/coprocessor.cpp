@@ -12,6 +12,9 @@ void ARM9Coprocessor::reset() {
     itcm.fill(0);
     dtcm_control.data = 0;
     itcm_control.data = 0;
+    memory.dtcm.config = {};
+    memory.itcm.config = {};
+    memory.update_tcm_mapping();
 }
 
 u32 ARM9Coprocessor::read(u32 cn, u32 cm, u32 cp) {
@@ -55,6 +58,7 @@ void ARM9Coprocessor::write(u32 cn, u32 cm, u32 cp, u32 value) {
         memory.dtcm.config.enable_writes = control.dtcm_enable;
         memory.itcm.config.enable_reads = control.itcm_enable && !control.itcm_write_only;
         memory.itcm.config.enable_writes = control.itcm_enable;
+        memory.update_tcm_mapping();
         break;
     case 0x020000:
     case 0x020001:
@@ -87,11 +91,13 @@ void ARM9Coprocessor::write(u32 cn, u32 cm, u32 cp, u32 value) {
         dtcm_control.data = value;
         memory.dtcm.config.base = dtcm_control.base << 12;
         memory.dtcm.config.limit = memory.dtcm.config.base + (512 << dtcm_control.size);
+        memory.update_tcm_mapping();
         break;
     case 0x090101:
         itcm_control.data = value;
         memory.itcm.config.base = 0;
         memory.itcm.config.limit = 512 << itcm_control.size;
+        memory.update_tcm_mapping();
         break;
     default:
         LOG_ERROR("ARM9Coprocessor: handle register write c%d, c%d, c%d = %08x", cn, cm, cp, value);
@@ -22,6 +22,10 @@ void ARM9Memory::reset() {
 
     map(0xffff0000, 0xffff8000, bios.data(), 0x7fff, arm::RegionAttributes::Read);
     map(0x02000000, 0x03000000, system.main_memory->data(), 0x3fffff, arm::RegionAttributes::ReadWrite);
+
+    // palette ram and oam writes stay on the slow path, since 8-bit writes are ignored
+    map(0x05000000, 0x06000000, system.video_unit.get_palette_ram(), 0x7ff, arm::RegionAttributes::Read);
+    map(0x07000000, 0x08000000, system.video_unit.get_oam(), 0x7ff, arm::RegionAttributes::Read);
     update_wram_mapping();
 }
 
@@ -42,6 +46,20 @@ void ARM9Memory::update_wram_mapping() {
     }
 }
 
+void ARM9Memory::update_vram_mapping() {
+    // pages with a single bank mapped can be read directly, while unmapped
+    // and overlapping pages go through the slow path. writes always take the
+    // slow path so that vram writes can be tracked
+    for (u32 addr = 0x06000000; addr < 0x07000000; addr += 0x1000) {
+        auto pointer = system.video_unit.vram.get_pointer(addr);
+        if (pointer) {
+            map(addr, addr + 0x1000, pointer, 0xfff, arm::RegionAttributes::Read);
+        } else {
+            unmap(addr, addr + 0x1000, arm::RegionAttributes::Read);
+        }
+    }
+}
+
 u8 ARM9Memory::read_byte(u32 addr) {
     switch (addr >> 24) {
     case 0x04:
@@ -14,6 +14,7 @@ public:
 
     void reset();
     void update_wram_mapping();
+    void update_vram_mapping();
 
     u8 read_byte(u32 addr) override;
     u16 read_half(u32 addr) override;
@@ -346,6 +346,9 @@ void ARM9Memory::mmio_write_word(u32 addr, u32 value) {
     case MMIO(0x04000064):
         system.video_unit.write_dispcapcnt(value, mask);
         break;
+    case MMIO(0x04000068):
+        system.video_unit.write_display_fifo(value);
+        break;
     case MMIO(0x0400006c):
         system.video_unit.ppu_a.write_master_bright(value, mask);
         break;
@@ -443,20 +446,20 @@ void ARM9Memory::mmio_write_word(u32 addr, u32 value) {
         system.arm9.get_irq().write_irf(value, mask);
         break;
     case MMIO(0x04000240):
-        if constexpr (mask & 0xff) system.video_unit.vram.write_vramcnt(VRAM::Bank::A, value);
-        if constexpr (mask & 0xff00) system.video_unit.vram.write_vramcnt(VRAM::Bank::B, value >> 8);
-        if constexpr (mask & 0xff0000) system.video_unit.vram.write_vramcnt(VRAM::Bank::C, value >> 16);
-        if constexpr (mask & 0xff000000) system.video_unit.vram.write_vramcnt(VRAM::Bank::D, value >> 24);
+        if constexpr (mask & 0xff) system.write_vramcnt(VRAM::Bank::A, value);
+        if constexpr (mask & 0xff00) system.write_vramcnt(VRAM::Bank::B, value >> 8);
+        if constexpr (mask & 0xff0000) system.write_vramcnt(VRAM::Bank::C, value >> 16);
+        if constexpr (mask & 0xff000000) system.write_vramcnt(VRAM::Bank::D, value >> 24);
         break;
     case MMIO(0x04000244):
-        if constexpr (mask & 0xff) system.video_unit.vram.write_vramcnt(VRAM::Bank::E, value);
-        if constexpr (mask & 0xff00) system.video_unit.vram.write_vramcnt(VRAM::Bank::F, value >> 8);
-        if constexpr (mask & 0xff0000) system.video_unit.vram.write_vramcnt(VRAM::Bank::G, value >> 16);
+        if constexpr (mask & 0xff) system.write_vramcnt(VRAM::Bank::E, value);
+        if constexpr (mask & 0xff00) system.write_vramcnt(VRAM::Bank::F, value >> 8);
+        if constexpr (mask & 0xff0000) system.write_vramcnt(VRAM::Bank::G, value >> 16);
         if constexpr (mask & 0xff000000) system.write_wramcnt(value >> 24);
         break;
     case MMIO(0x04000248):
-        if constexpr (mask & 0xff) system.video_unit.vram.write_vramcnt(VRAM::Bank::H, value);
-        if constexpr (mask & 0xff00) system.video_unit.vram.write_vramcnt(VRAM::Bank::I, value >> 8);
+        if constexpr (mask & 0xff) system.write_vramcnt(VRAM::Bank::H, value);
+        if constexpr (mask & 0xff00) system.write_vramcnt(VRAM::Bank::I, value >> 8);
         break;
     case MMIO(0x04000280):
         system.maths_unit.write_divcnt(value, mask);
@@ -34,6 +34,31 @@ void DMA::trigger(Timing timing) {
     }
 }
 
+std::optional<u32> DMA::advance_main_memory_display(int words) {
+    for (int i = 0; i < 4; i++) {
+        auto& channel = channels[i];
+        if (!channel.control.enable || channel.control.timing != Timing::MainMemoryDisplay) {
+            continue;
+        }
+
+        u32 source = channel.internal_source;
+        channel.internal_source += words * 4;
+
+        // each refill would raise an irq, but one per scanline is close enough
+        if (channel.control.irq) {
+            raise_irq(i);
+        }
+
+        if (!channel.control.repeat) {
+            channel.control.enable = false;
+        }
+
+        return source;
+    }
+
+    return std::nullopt;
+}
+
 u16 DMA::read_length(int id) {
     return channels[id].length;
 }
@@ -138,20 +163,7 @@ void DMA::transfer(int id) {
     }
 
     if (channel.control.irq) {
-        switch (id) {
-        case 0:
-            irq.raise(IRQ::Source::DMA0);
-            break;
-        case 1:
-            irq.raise(IRQ::Source::DMA1);
-            break;
-        case 2:
-            irq.raise(IRQ::Source::DMA2);
-            break;
-        case 3:
-            irq.raise(IRQ::Source::DMA3);
-            break;
-        }
+        raise_irq(id);
     }
 
     if (channel.control.repeat && channel.control.timing != Timing::Immediate) {
@@ -170,4 +182,21 @@ void DMA::transfer(int id) {
     }
 }
 
+void DMA::raise_irq(int id) {
+    switch (id) {
+    case 0:
+        irq.raise(IRQ::Source::DMA0);
+        break;
+    case 1:
+        irq.raise(IRQ::Source::DMA1);
+        break;
+    case 2:
+        irq.raise(IRQ::Source::DMA2);
+        break;
+    case 3:
+        irq.raise(IRQ::Source::DMA3);
+        break;
+    }
+}
+
 } // namespace nds
\ No newline at end of file
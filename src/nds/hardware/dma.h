@@ -1,6 +1,7 @@
 #pragma once
 
 #include <array>
+#include <optional>
 #include "common/types.h"
 #include "common/scheduler.h"
 #include "arm/arch.h"
@@ -28,6 +29,12 @@ public:
 
     void trigger(Timing timing);
 
+    // main memory display dma refills the display fifo 4 words at a time as it drains,
+    // so instead of 32 transfers per scanline the video unit copies a whole scanline
+    // straight from main memory, and only the channel state gets advanced here
+    // returns where the scanline starts, or nothing if no channel is set up for main memory display
+    std::optional<u32> advance_main_memory_display(int words);
+
     u32 read_source(int id) { return channels[id].source; }
     u16 read_length(int id);
     u16 read_control(int id);
@@ -43,6 +50,7 @@ public:
 
 private:
     void transfer(int id);
+    void raise_irq(int id);
 
     enum AddressMode : u16 {
         Increment = 0,
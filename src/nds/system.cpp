@@ -18,6 +18,7 @@ System::System() :
     timers9(scheduler, arm9.get_irq())
 {
     main_memory = std::make_unique<std::array<u8, 0x400000>>();
+    configure_framebuffers(2, 256, 192);
     
     arm::Config config;
     config.block_size = 1;
@@ -28,6 +29,9 @@ System::System() :
 
 System::~System() {
     stop();
+
+    // the render thread uses the thread pool, which gets destroyed before the video unit
+    video_unit.gpu.wait_for_render();
 }
 
 void System::reset() {
@@ -41,6 +45,8 @@ void System::reset() {
     }
     
     video_unit.reset();
+    arm7.get_memory().update_vram_mapping();
+    arm9.get_memory().update_vram_mapping();
     input.reset();
     spu.reset();
     dma7.reset();
@@ -100,10 +106,6 @@ void System::run_frame() {
         scheduler.tick(cycles);
         scheduler.run();
     }
-
-    // TODO: move this to VideoUnit when hblank or end of frame occurs
-    video_unit.ppu_a.on_finish_frame();
-    video_unit.ppu_b.on_finish_frame();
 }
 
 void System::set_audio_device(std::shared_ptr<common::AudioDevice> audio_device) {
@@ -111,10 +113,6 @@ void System::set_audio_device(std::shared_ptr<common::AudioDevice> audio_device)
     spu.set_audio_device(audio_device);
 }
 
-std::vector<u32*> System::fetch_framebuffers() {
-    return {video_unit.fetch_framebuffer(Screen::Top), video_unit.fetch_framebuffer(Screen::Bottom)};
-}
-
 void System::configure_cpu_backend(arm::Config config) {
     arm7.configure_cpu_backend(config);
     arm9.configure_cpu_backend(config);
@@ -126,6 +124,16 @@ void System::write_wramcnt(u8 value) {
     arm9.get_memory().update_wram_mapping();
 }
 
+void System::write_vramcnt(VRAM::Bank bank, u8 value) {
+    // the 3d renderer reads texture vram from its own thread, so let it finish before remapping
+    video_unit.gpu.wait_for_render();
+
+    if (video_unit.vram.write_vramcnt(bank, value)) {
+        arm7.get_memory().update_vram_mapping();
+        arm9.get_memory().update_vram_mapping();
+    }
+}
+
 void System::write_haltcnt(u8 value) {
     haltcnt = value & 0xc0;
     switch ((haltcnt >> 6) & 0x3) {
@@ -5,6 +5,7 @@
 #include "common/types.h"
 #include "common/system.h"
 #include "common/scheduler.h"
+#include "common/thread_pool.h"
 #include "arm/config.h"
 #include "nds/arm7/arm7.h"
 #include "nds/arm9/arm9.h"
@@ -30,11 +31,11 @@ public:
     void reset() override;
     void run_frame() override;
     void set_audio_device(std::shared_ptr<common::AudioDevice> audio_device) override;
-    std::vector<u32*> fetch_framebuffers() override;
     void configure_cpu_backend(arm::Config config);
     
     u8 read_wramcnt() { return wramcnt; }
     void write_wramcnt(u8 value);
+    void write_vramcnt(VRAM::Bank bank, u8 value);
     void write_haltcnt(u8 value);
 
     u16 read_exmemcnt() { return exmemcnt; }
@@ -61,6 +62,7 @@ public:
     Timers timers9;
     Wifi wifi;
     common::Scheduler scheduler;
+    common::ThreadPool thread_pool;
     std::unique_ptr<std::array<u8, 0x400000>> main_memory;
     std::array<u8, 0x8000> shared_wram;
     u8 wramcnt;
@@ -1,7 +1,7 @@
 #pragma once
 
 #include "common/types.h"
-#include "nds/video/gpu/polygon.h"
+#include "nds/video/gpu/geometry_buffer.h"
 
 namespace nds {
 
@@ -9,9 +9,18 @@ struct Renderer {
     virtual ~Renderer() = default;
 
     virtual void reset() = 0;
+
+    // starts rendering the submitted geometry, which may finish asynchronously
     virtual void render() = 0;
-    virtual u32* fetch_framebuffer() = 0;
-    virtual void submit_polygons(Polygon* polygons, int num_polygons, bool w_buffering) = 0;
+
+    // blocks until the frame being rendered has finished
+    virtual void wait_for_render() = 0;
+
+    // returns a scanline of the last rendered frame, blocking until it's ready
+    virtual const u32* fetch_scanline(int line) = 0;
+
+    // the geometry buffer must stay unmodified until the next buffer gets submitted
+    virtual void submit_geometry(const GeometryBuffer& geometry) = 0;
 };
 
 } // namespace nds
\ No newline at end of file
@@ -1,52 +1,79 @@
+#include "common/simd.h"
 #include "nds/video/gpu/vertex.h"
 
 namespace nds {
 
 // an interpolate which does perspective correct and linear interpolation
 // for colour and texture coordinates
-// TODO: do optimisations where possible
 template <int precision>
 class Interpolator {
 public:
     // we assume that x is between x0 and x1 and x0 < x1
     u32 interpolate(u32 u0, u32 u1, u32 x, u32 x0, u32 x1, u32 w0, u32 w1) {
+        return blend(u0, u1, perspective_factor(x, x0, x1, w0, w1));
+    }
+
+    // we assume that x is between x0 and x1 and x0 < x1
+    u32 interpolate_linear(u32 u0, u32 u1, u32 x, u32 x0, u32 x1) {
+        return blend(u0, u1, linear_factor(x, x0, x1));
+    }
+
+    // the factor only depends on the position and w values, so it can be calculated once
+    // and then shared between every attribute being interpolated
+    u32 perspective_factor(u32 x, u32 x0, u32 x1, u32 w0, u32 w1) {
         if (use_linear_interpolation(w0, w1)) {
-            return interpolate_linear(u0, u1, x, x0, x1);
+            return linear_factor(x, x0, x1);
         }
 
         u32 t0 = x - x0;
         u32 t1 = x1 - x;
-        u32 denom = t0 * w0 + t1 * w1;
-        u32 factor = 0;
+        return perspective_factor(t0 * w0, t0 * w0 + t1 * w1);
+    }
 
-        if (denom != 0) {
-            factor = ((t0 * w0) << precision) / denom;
+    // where numerator = t0 * w0 and denominator = t0 * w0 + t1 * w1
+    u32 perspective_factor(u32 numerator, u32 denominator) {
+        if (denominator == 0) {
+            return 0;
         }
 
-        return (u0 * ((1 << precision) - factor) + u1 * factor) >> precision;
+        return (numerator << precision) / denominator;
     }
 
-    // we assume that x is between x0 and x1 and x0 < x1
-    u32 interpolate_linear(u32 u0, u32 u1, u32 x, u32 x0, u32 x1) {
-        u32 denom = x1 - x0;
-        u32 factor = 0;
+    // calculates the factors for several pixels at once
+    common::u32x8 perspective_factor(common::u32x8 numerator, common::u32x8 denominator) {
+        return common::divide(numerator << precision, denominator);
+    }
 
-        if (denom != 0) {
-            factor = ((x - x0) << precision) / denom;
+    u32 linear_factor(u32 x, u32 x0, u32 x1) {
+        u32 denom = x1 - x0;
+        if (denom == 0) {
+            return 0;
         }
 
+        return ((x - x0) << precision) / denom;
+    }
+
+    u32 blend(u32 u0, u32 u1, u32 factor) {
         return (u0 * ((1 << precision) - factor) + u1 * factor) >> precision;
     }
 
-    Colour interpolate_colour(Colour c1, Colour c2, u32 x, u32 x0, u32 x1, u32 w0, u32 w1) {
+    common::u32x8 blend(u32 u0, u32 u1, common::u32x8 factor) {
+        return (u0 * (static_cast<u32>(1 << precision) - factor) + u1 * factor) >> precision;
+    }
+
+    Colour blend_colour(Colour c1, Colour c2, u32 factor) {
         Colour c3;
-        c3.r = interpolate(c1.r, c2.r, x, x0, x1, w0, w1);
-        c3.g = interpolate(c1.g, c2.g, x, x0, x1, w0, w1);
-        c3.b = interpolate(c1.b, c2.b, x, x0, x1, w0, w1);
+        c3.r = blend(c1.r, c2.r, factor);
+        c3.g = blend(c1.g, c2.g, factor);
+        c3.b = blend(c1.b, c2.b, factor);
 
         return c3;
     }
 
+    Colour interpolate_colour(Colour c1, Colour c2, u32 x, u32 x0, u32 x1, u32 w0, u32 w1) {
+        return blend_colour(c1, c2, perspective_factor(x, x0, x1, w0, w1));
+    }
+
     // we assume that x is between x0 and x1 and x0 < x1
     u32 interpolate_colour_component(u32 u0, u32 u1, u32 x, u32 x0, u32 x1, u32 w0, u32 w1) {
         u32 t0 = x - x0;
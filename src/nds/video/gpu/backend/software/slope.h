@@ -26,6 +26,7 @@ struct Point {
 // a horizontal line on 1 scanline that represents a small part of a full line
 class Slope {
 public:
+    Slope() = default;
     Slope(const Vertex& v0, const Vertex& v1) {
         setup(v0.x, v0.y, v1.x, v1.y);
     }
@@ -73,12 +74,12 @@ public:
     }
 
     // returns the x coordinate of the start of the span without fractional bits
-    s32 span_start(s32 y) {
+    s32 span_start(s32 y) const {
         return frac_span_start(y) >> FRAC_BITS;
     }
 
     // returns the x coordinate of the end of the span without fractional bits
-    s32 span_end(s32 y) {
+    s32 span_end(s32 y) const {
         return frac_span_end(y) >> FRAC_BITS;
     }
 
@@ -87,7 +88,7 @@ public:
     
 private:
     // returns the x coordinate of the start of the span with fractional bits
-    s32 frac_span_start(s32 y) {
+    s32 frac_span_start(s32 y) const {
         s32 displacement = (y - p0.y) * dx;
         if (negative) {
             return p0.x - displacement;
@@ -97,7 +98,7 @@ private:
     }
 
     // returns the x coordinate of the end of the span with fractional bits
-    s32 frac_span_end(s32 y) {
+    s32 frac_span_end(s32 y) const {
         s32 result = frac_span_start(y);
 
         // y major lines only have 1 pixel per scanline
@@ -1,43 +1,170 @@
 #include <algorithm>
 #include "common/logger.h"
+#include "common/colour.h"
 #include "nds/video/gpu/backend/software/software_renderer.h"
 #include "nds/video/vram_region.h"
 
 namespace nds {
 
-SoftwareRenderer::SoftwareRenderer(GPU::DISP3DCNT& disp3dcnt, VRAMRegion& texture_data, VRAMRegion& texture_palette) : disp3dcnt(disp3dcnt), texture_data(texture_data), texture_palette(texture_palette) {}
+SoftwareRenderer::SoftwareRenderer(const GPU::RenderRegisters& live_registers, VRAMRegion& texture_data, VRAMRegion& texture_palette, common::ThreadPool& thread_pool) : texture_cache(texture_data, texture_palette), live_registers(live_registers), thread_pool(thread_pool) {
+    setups.reserve(2048);
+
+    for (auto& ready : line_ready) {
+        ready = true;
+    }
+
+    render_thread = std::thread([this]() {
+        run_render_thread();
+    });
+}
+
+SoftwareRenderer::~SoftwareRenderer() {
+    wait_for_render();
+
+    {
+        std::lock_guard lock{render_mutex};
+        running = false;
+    }
+
+    render_requested.notify_all();
+    render_thread.join();
+}
 
 void SoftwareRenderer::reset() {
-    framebuffer.fill(0);
+    wait_for_render();
+    framebuffer.fill(colour_transparent);
+    colour_buffer.fill(0);
     depth_buffer.fill(0xffffff);
+    attribute_buffer.fill(0);
+    fog_density.fill(0);
+    texture_cache.reset();
 }
 
 void SoftwareRenderer::render() {
+    wait_for_render();
+    registers = live_registers;
+
+    for (auto& ready : line_ready) {
+        ready = false;
+    }
+
+    {
+        std::lock_guard lock{render_mutex};
+        render_pending = true;
+    }
+
+    render_requested.notify_one();
+}
+
+void SoftwareRenderer::wait_for_render() {
+    std::unique_lock lock{render_mutex};
+    render_finished.wait(lock, [this]() {
+        return !render_pending;
+    });
+}
+
+const u32* SoftwareRenderer::fetch_scanline(int line) {
+    line_ready[line].wait(false);
+    return framebuffer.data() + (line * 256);
+}
+
+void SoftwareRenderer::run_render_thread() {
+    std::unique_lock lock{render_mutex};
+    while (true) {
+        render_requested.wait(lock, [this]() {
+            return !running || render_pending;
+        });
+
+        if (!running) {
+            return;
+        }
+
+        lock.unlock();
+        render_frame();
+        lock.lock();
+
+        render_pending = false;
+        render_finished.notify_all();
+    }
+}
+
+void SoftwareRenderer::render_frame() {
     // TODO: ideally we should render scanline by scanline
     // figure out how this works on real hardware
-    framebuffer.fill(0);
+    // TODO: handle the rear plane bitmap
+    const u32 clear = registers.clear_colour;
+    const u32 depth = registers.clear_depth & 0x7fff;
+    clear_colour = (clear & 0x7fff) | (((clear >> 16) & 0x1f) << 15);
+    clear_depth = (depth * 0x200) + ((depth + 1) / 0x8000) * 0x1ff;
+    clear_attributes = ((clear >> 24) & OPAQUE_ID) | (((clear >> 15) & 0x1) ? FOG : 0);
+
+    if (registers.disp3dcnt.fog_enable) {
+        build_fog_density_table();
+    }
 
-    // depth values are 24 bits (0 - 0xffffff)
-    depth_buffer.fill(0xffffff);
+    texture_cache.begin_frame();
+    setup_polygons();
 
-    for (int i = 0; i < 192; i++) {
-        render_scanline(i);
-    }
+    // each band only touches its own scanlines and draws polygons in submission order,
+    // so the output is the same as rendering every scanline on a single thread
+    thread_pool.run(NUM_BANDS, [this](int band) {
+        render_band(band);
+    });
+
+    // edge marking looks at the scanlines above and below, so it has to wait until every band is drawn
+    thread_pool.run(NUM_BANDS, [this](int band) {
+        finish_band(band);
+    });
 }
 
-void SoftwareRenderer::submit_polygons(Polygon* polygons, int num_polygons, bool w_buffering) {
-    this->polygons = polygons;
-    this->num_polygons = num_polygons;
-    this->w_buffering = w_buffering;
+void SoftwareRenderer::submit_geometry(const GeometryBuffer& geometry) {
+    // the previous buffer is about to be reused by the gpu
+    wait_for_render();
+    polygons = geometry.polygons.data();
+    num_polygons = geometry.num_polygons;
+    w_buffering = geometry.w_buffering;
 }
 
-void SoftwareRenderer::render_scanline(int y) {
-    for (int i = 0; i < num_polygons; i++) {
-        render_polygon_scanline(polygons[i], y);
+void SoftwareRenderer::setup_polygons() {
+    setups.clear();
+
+    for (auto& bin : bins) {
+        bin.clear();
+    }
+
+    // opaque polygons are always drawn before translucent polygons
+    for (int pass = 0; pass < 2; pass++) {
+        for (int i = 0; i < num_polygons; i++) {
+            if (is_translucent(polygons[i]) != (pass == 1)) {
+                continue;
+            }
+
+            PolygonSetup setup;
+            setup_polygon(setup, polygons[i]);
+
+            // polygons with no height never produce any pixels
+            if (setup.top >= setup.bottom) {
+                continue;
+            }
+
+            // TODO: shadow polygons with an id of 0 only mark the stencil buffer, which isn't handled yet
+            if (polygons[i].polygon_attributes.polygon_mode == Polygon::PolygonMode::Shadow && polygons[i].polygon_attributes.id == 0) {
+                continue;
+            }
+
+            int index = setups.size();
+            setups.push_back(setup);
+
+            int first_band = setup.top / BAND_HEIGHT;
+            int last_band = (setup.bottom - 1) / BAND_HEIGHT;
+            for (int band = first_band; band <= last_band; band++) {
+                bins[band].push_back(index);
+            }
+        }
     }
 }
 
-void SoftwareRenderer::render_polygon_scanline(Polygon& polygon, int y) {
+void SoftwareRenderer::setup_polygon(PolygonSetup& setup, const Polygon& polygon) {
     int start = 0;
     int end = 0;
 
@@ -57,104 +184,595 @@ void SoftwareRenderer::render_polygon_scanline(Polygon& polygon, int y) {
         }
     }
 
-    int left = start;
-    int right = start;
-    int next_left = polygon.next(left);
-    int next_right = polygon.prev(right);
+    setup.polygon = &polygon;
+    setup.texture = registers.disp3dcnt.texture_mapping ? texture_cache.get(polygon.texture_attributes) : nullptr;
+    setup.top = std::clamp<s32>(polygon.vertices[start]->y, 0, 192);
+    setup.bottom = std::clamp<s32>(polygon.vertices[end]->y, 0, 192);
 
-    while (polygon.vertices[next_left]->y <= y && next_left != end) {
-        left = next_left;
-        next_left = polygon.next(left);
+    // TODO: polygons with an alpha of 0 should be drawn as wireframes, for now draw them as solid
+    setup.alpha = polygon.polygon_attributes.alpha == 0 ? 31 : polygon.polygon_attributes.alpha;
+
+    if (setup.top >= setup.bottom) {
+        return;
     }
 
-    while (polygon.vertices[next_right]->y <= y && next_right != end) {
-        right = next_right;
-        next_right = polygon.prev(right);
+    // walk the left edges anticlockwise and the right edges clockwise until they meet at the bottom vertex
+    for (int current = start; current != end; current = polygon.next(current)) {
+        auto& edge = setup.left_edges[setup.num_left_edges++];
+        edge.v0 = polygon.vertices[current];
+        edge.v1 = polygon.vertices[polygon.next(current)];
+        edge.slope = Slope{*edge.v0, *edge.v1};
     }
 
-    const auto left_vertex = polygon.vertices[left];
-    const auto next_left_vertex = polygon.vertices[next_left];
-    const auto right_vertex = polygon.vertices[right];
-    const auto next_right_vertex = polygon.vertices[next_right];
+    for (int current = start; current != end; current = polygon.prev(current)) {
+        auto& edge = setup.right_edges[setup.num_right_edges++];
+        edge.v0 = polygon.vertices[current];
+        edge.v1 = polygon.vertices[polygon.prev(current)];
+        edge.slope = Slope{*edge.v0, *edge.v1};
+    }
+}
+
+bool SoftwareRenderer::is_translucent(const Polygon& polygon) {
+    const auto alpha = polygon.polygon_attributes.alpha;
+    const auto format = polygon.texture_attributes.parameters.texture_format;
+    return (alpha != 0 && alpha != 31) || format == Polygon::TextureFormat::A3I5 || format == Polygon::TextureFormat::A5I3;
+}
+
+void SoftwareRenderer::clear_band(int band) {
+    u32 first_addr = band * BAND_HEIGHT * 256;
+    u32 last_addr = first_addr + (BAND_HEIGHT * 256);
+
+    std::fill(colour_buffer.begin() + first_addr, colour_buffer.begin() + last_addr, clear_colour);
+    std::fill(depth_buffer.begin() + first_addr, depth_buffer.begin() + last_addr, clear_depth);
+    std::fill(attribute_buffer.begin() + first_addr, attribute_buffer.begin() + last_addr, clear_attributes);
+}
+
+void SoftwareRenderer::render_band(int band) {
+    int first_line = band * BAND_HEIGHT;
+
+    clear_band(band);
+
+    for (int y = first_line; y < first_line + BAND_HEIGHT; y++) {
+        for (int index : bins[band]) {
+            const auto& setup = setups[index];
+            if (y >= setup.top && y < setup.bottom) {
+                render_polygon_scanline(setup, y);
+            }
+        }
+    }
+}
 
-    Slope left_slope{*left_vertex, *next_left_vertex};
-    Slope right_slope{*right_vertex, *next_right_vertex};
+void SoftwareRenderer::finish_band(int band) {
+    int first_line = band * BAND_HEIGHT;
+
+    for (int y = first_line; y < first_line + BAND_HEIGHT; y++) {
+        if (registers.disp3dcnt.edge_marking) {
+            mark_edges(y);
+        }
+
+        if (registers.disp3dcnt.fog_enable) {
+            apply_fog(y);
+        }
+
+        output_scanline(y);
+
+        // let the 2d engines and display capture use the scanline straight away
+        line_ready[y].store(true, std::memory_order_release);
+        line_ready[y].notify_all();
+    }
+}
+
+const SoftwareRenderer::Edge& SoftwareRenderer::find_edge(const std::array<Edge, 10>& edges, int num_edges, int y) {
+    // the edge used on a scanline is the first one which ends below it,
+    // otherwise the last edge which ends at the bottom vertex
+    int i = 0;
+    while (i < num_edges - 1 && edges[i].v1->y <= y) {
+        i++;
+    }
+
+    return edges[i];
+}
+
+void SoftwareRenderer::render_polygon_scanline(const PolygonSetup& setup, int y) {
+    const auto& left_edge = find_edge(setup.left_edges, setup.num_left_edges, y);
+    const auto& right_edge = find_edge(setup.right_edges, setup.num_right_edges, y);
+    const auto left_vertex = left_edge.v0;
+    const auto next_left_vertex = left_edge.v1;
+    const auto right_vertex = right_edge.v0;
+    const auto next_right_vertex = right_edge.v1;
+    const auto& left_slope = left_edge.slope;
+    const auto& right_slope = right_edge.slope;
+
+    if (y < left_vertex->y || y >= next_left_vertex->y || y < right_vertex->y || y >= next_right_vertex->y) {
+        return;
+    }
 
     Interpolator<9> slope_interpolator;
-    Interpolator<8> span_interpolator;
+    Span span;
 
-    s32 span_start = left_slope.span_start(y);
-    s32 span_end = right_slope.span_end(y);
+    span.start = left_slope.span_start(y);
+    span.end = right_slope.span_end(y);
+    span.left_edge_end = std::max(span.start, left_slope.span_end(y));
+    span.right_edge_start = std::min(right_slope.span_start(y), span.end);
+    span.edge_row = y == setup.top || y == setup.bottom - 1;
+
+    // every attribute along an edge shares the same factors, so only calculate them once per edge
+    u32 left_factor = slope_interpolator.perspective_factor(y, left_vertex->y, next_left_vertex->y, left_vertex->w, next_left_vertex->w);
+    u32 right_factor = slope_interpolator.perspective_factor(y, right_vertex->y, next_right_vertex->y, right_vertex->w, next_right_vertex->w);
+    u32 left_linear_factor = slope_interpolator.linear_factor(y, left_vertex->y, next_left_vertex->y);
+    u32 right_linear_factor = slope_interpolator.linear_factor(y, right_vertex->y, next_right_vertex->y);
 
     // calculate the current w value along each slope at y
-    s32 w0 = slope_interpolator.interpolate(left_vertex->w, next_left_vertex->w, y, left_vertex->y, next_left_vertex->y, left_vertex->w, next_left_vertex->w);
-    s32 w1 = slope_interpolator.interpolate(right_vertex->w, next_right_vertex->w, y, right_vertex->y, next_right_vertex->y, right_vertex->w, next_right_vertex->w);
+    span.w0 = slope_interpolator.blend(left_vertex->w, next_left_vertex->w, left_factor);
+    span.w1 = slope_interpolator.blend(right_vertex->w, next_right_vertex->w, right_factor);
     
     // calculate the current depth value along each slope at y
-    u32 z0 = slope_interpolator.interpolate_linear(left_vertex->z, next_left_vertex->z, y, left_vertex->y, next_left_vertex->y);
-    u32 z1 = slope_interpolator.interpolate_linear(right_vertex->z, next_right_vertex->z, y, right_vertex->y, next_right_vertex->y);
+    span.z0 = slope_interpolator.blend(left_vertex->z, next_left_vertex->z, left_linear_factor);
+    span.z1 = slope_interpolator.blend(right_vertex->z, next_right_vertex->z, right_linear_factor);
 
     // calculate the current colour value along each slope at y
-    Colour c0 = slope_interpolator.interpolate_colour(left_vertex->colour, next_left_vertex->colour, y, left_vertex->y, next_left_vertex->y, 0, 0);
-    Colour c1 = slope_interpolator.interpolate_colour(right_vertex->colour, next_right_vertex->colour, y, right_vertex->y, next_right_vertex->y, 0, 0);
+    span.c0 = slope_interpolator.blend_colour(left_vertex->colour, next_left_vertex->colour, left_linear_factor);
+    span.c1 = slope_interpolator.blend_colour(right_vertex->colour, next_right_vertex->colour, right_linear_factor);
 
     // calculate the current texture coords along each slope at y
-    s16 s0 = slope_interpolator.interpolate(left_vertex->s, next_left_vertex->s, y, left_vertex->y, next_left_vertex->y, left_vertex->w, next_left_vertex->w);
-    s16 s1 = slope_interpolator.interpolate(right_vertex->s, next_right_vertex->s, y, right_vertex->y, next_right_vertex->y, right_vertex->w, next_right_vertex->w);
-    s16 t0 = slope_interpolator.interpolate(left_vertex->t, next_left_vertex->t, y, left_vertex->y, next_left_vertex->y, left_vertex->w, next_left_vertex->w);
-    s16 t1 = slope_interpolator.interpolate(right_vertex->t, next_right_vertex->t, y, right_vertex->y, next_right_vertex->y, right_vertex->w, next_right_vertex->w);
+    span.s0 = slope_interpolator.blend(left_vertex->s, next_left_vertex->s, left_factor);
+    span.s1 = slope_interpolator.blend(right_vertex->s, next_right_vertex->s, right_factor);
+    span.t0 = slope_interpolator.blend(left_vertex->t, next_left_vertex->t, left_factor);
+    span.t1 = slope_interpolator.blend(right_vertex->t, next_right_vertex->t, right_factor);
+
+    if (span.start > span.end) {
+        std::swap(span.start, span.end);
+        std::swap(span.w0, span.w1);
+        std::swap(span.z0, span.z1);
+        std::swap(span.c0, span.c1);
+        std::swap(span.s0, span.s1);
+        std::swap(span.t0, span.t1);
+        span.left_edge_end = span.start;
+        span.right_edge_start = span.end;
+    }
 
-    if (span_start > span_end) {
-        std::swap(span_start, span_end);
-        std::swap(w0, w1);
-        std::swap(z0, z1);
-        std::swap(c0, c1);
-        std::swap(s0, s1);
-        std::swap(t0, t1);
+    // clip the span to the screen before stepping across it
+    span.x_start = std::max(span.start, 0);
+    span.x_end = std::min(span.end, 255);
+    if (span.x_start > span.x_end) {
+        return;
+    }
+
+    if constexpr (common::simd_accelerated) {
+        render_span_simd(span, setup, y);
+    } else {
+        render_span(span, setup, y);
     }
+}
 
-    if ((y >= left_vertex->y && y < next_left_vertex->y) && (y >= right_vertex->y && y < next_right_vertex->y)) {
-        for (int x = span_start; x <= span_end; x++) {
-            if (x < 0 || x > 255) continue;
+// the perspective factor at x is t0 * w0 / (t0 * w0 + t1 * w1) where t0 = x - span.start and t1 = span.end - x,
+// so the numerator and denominator step linearly across the span and every attribute shares the same factor
+void SoftwareRenderer::render_span(const Span& span, const PolygonSetup& setup, int y) {
+    Interpolator<8> span_interpolator;
+    const bool linear = span_interpolator.use_linear_interpolation(span.w0, span.w1);
+    const bool needs_linear_factor = linear || !w_buffering;
+    const bool depth_test_equal = setup.polygon->polygon_attributes.depth_test_equal;
+    const auto& parameters = setup.polygon->texture_attributes.parameters;
+    const s32 margin = w_buffering ? 0xff : 0x200;
+    u32 numerator = static_cast<u32>(span.x_start - span.start) * span.w0;
+    u32 denominator = numerator + static_cast<u32>(span.end - span.x_start) * span.w1;
+    u32 numerator_step = span.w0;
+    u32 denominator_step = span.w0 - span.w1;
+    u32 linear_numerator = static_cast<u32>(span.x_start - span.start) << 8;
+    u32 linear_denominator = span.end - span.start;
+
+    for (int x = span.x_start; x <= span.x_end; x++) {
+        u32 addr = (256 * y) + x;
+        u32 linear_factor = 0;
+        u32 factor = 0;
+
+        if (needs_linear_factor && linear_denominator != 0) {
+            linear_factor = linear_numerator / linear_denominator;
+        }
 
-            u32 addr = (256 * y) + x;
-            u32 depth = 0;
+        if (linear) {
+            factor = linear_factor;
+        } else {
+            factor = span_interpolator.perspective_factor(numerator, denominator);
+        }
 
-            if (w_buffering) {
-                depth = span_interpolator.interpolate(w0, w1, x, span_start, span_end, w0, w1);
-            } else {
-                depth = span_interpolator.interpolate_linear(z0, z1, x, span_start, span_end);
-            }
+        numerator += numerator_step;
+        denominator += denominator_step;
+        linear_numerator += 1 << 8;
 
-            if (!depth_test(depth_buffer[addr], depth, polygon.polygon_attributes.depth_test_equal)) {
+        u32 depth = 0;
+
+        if (w_buffering) {
+            depth = span_interpolator.blend(span.w0, span.w1, factor);
+        } else {
+            depth = span_interpolator.blend(span.z0, span.z1, linear_factor);
+        }
+
+        if (depth_test_equal) {
+            if (std::abs(static_cast<s32>(depth) - static_cast<s32>(depth_buffer[addr])) > margin) {
                 continue;
             }
+        } else if (depth >= depth_buffer[addr]) {
+            continue;
+        }
 
-            // calculate colour value for scanline at x
-            Colour c = span_interpolator.interpolate_colour(c0, c1, x, span_start, span_end, w0, w1);
+        // calculate colour value for scanline at x
+        Colour colour = span_interpolator.blend_colour(span.c0, span.c1, factor);
+        u32 texel = 0;
 
+        if (setup.texture) {
             // calculate texture coords for scanline at x
-            s16 s = span_interpolator.interpolate(s0, s1, x, span_start, span_end, w0, w1);
-            s16 t = span_interpolator.interpolate(t0, t1, x, span_start, span_end, w0, w1);
+            s16 s = span_interpolator.blend(span.s0, span.s1, factor);
+            s16 t = span_interpolator.blend(span.t0, span.t1, factor);
+            texel = sample_texture(s, t, *setup.texture, parameters);
+        }
+
+        u32 edge = (span.edge_row || x <= span.left_edge_end || x >= span.right_edge_start) ? 0xffffffff : 0;
+        draw_fragments<u32>(0xffffffff, depth, colour.r, colour.g, colour.b, texel, edge, addr, 1, setup);
+    }
+}
+
+// the same as render_span, but handles several pixels at a time
+void SoftwareRenderer::render_span_simd(const Span& span, const PolygonSetup& setup, int y) {
+    using common::u32x8;
+    Interpolator<8> span_interpolator;
+    constexpr int lanes = common::lanes<u32x8>();
+    const u32x8 lane_offsets = {0, 1, 2, 3, 4, 5, 6, 7};
+    const bool linear = span_interpolator.use_linear_interpolation(span.w0, span.w1);
+    const bool depth_test_equal = setup.polygon->polygon_attributes.depth_test_equal;
+    const auto& parameters = setup.polygon->texture_attributes.parameters;
+    const u32 margin = w_buffering ? 0xff : 0x200;
+    const u32 w0 = span.w0;
+    const u32 w1 = span.w1;
+    const u32 start_offset = span.x_start - span.start;
+    const u32 numerator = start_offset * w0;
+    const u32 denominator = numerator + static_cast<u32>(span.end - span.x_start) * w1;
+    const u32 linear_denominator = span.end - span.start;
+    const u32 length = span.x_end - span.x_start + 1;
+
+    // x is never negative here, so the edge bounds can be compared as unsigned
+    const u32 left_edge_bound = std::max(span.left_edge_end + 1, 0);
+    const u32 right_edge_bound = std::max(span.right_edge_start, 0);
+    const u32 edge_row = span.edge_row ? 0xffffffff : 0;
+
+    for (int x = span.x_start; x <= span.x_end; x += lanes) {
+        const int count = std::min(lanes, span.x_end - x + 1);
+        const u32 addr = (256 * y) + x;
+        const u32x8 offsets = lane_offsets + static_cast<u32>(x - span.x_start);
+        const u32x8 xs = lane_offsets + static_cast<u32>(x);
+
+        u32x8 linear_factor{};
+        if (linear || !w_buffering) {
+            linear_factor = span_interpolator.perspective_factor(start_offset + offsets, common::splat<u32x8>(linear_denominator));
+        }
+
+        u32x8 factor = linear_factor;
+        if (!linear) {
+            factor = span_interpolator.perspective_factor(numerator + offsets * w0, denominator + offsets * (w0 - w1));
+        }
+
+        u32x8 depth = w_buffering ? span_interpolator.blend(w0, w1, factor) : span_interpolator.blend(span.z0, span.z1, linear_factor);
+        u32x8 old_depth = common::load<u32x8>(&depth_buffer[addr], count);
+
+        // |depth - old_depth| <= margin can be checked with a single unsigned compare
+        u32x8 pass = common::less_than(offsets, common::splat<u32x8>(length));
+        if (depth_test_equal) {
+            pass &= common::less_than(depth - old_depth + margin, common::splat<u32x8>(2 * margin + 1));
+        } else {
+            pass &= common::less_than(depth, old_depth);
+        }
+
+        u32x8 r = span_interpolator.blend(span.c0.r, span.c1.r, factor) & 0x1f;
+        u32x8 g = span_interpolator.blend(span.c0.g, span.c1.g, factor) & 0x1f;
+        u32x8 b = span_interpolator.blend(span.c0.b, span.c1.b, factor) & 0x1f;
+        u32x8 texel{};
+
+        if (setup.texture) {
+            // texture lookups are done per pixel
+            u32x8 s = span_interpolator.blend(span.s0, span.s1, factor);
+            u32x8 t = span_interpolator.blend(span.t0, span.t1, factor);
+
+            texel = common::transform([&](u32 s, u32 t) {
+                return sample_texture(s, t, *setup.texture, parameters);
+            }, s, t);
+        }
+
+        u32x8 edge = edge_row | common::less_than(xs, common::splat<u32x8>(left_edge_bound)) | ~common::less_than(xs, common::splat<u32x8>(right_edge_bound));
+        draw_fragments(pass, depth, r, g, b, texel, edge, addr, count, setup);
+    }
+}
+
+// works out the colour of each fragment from the vertex colour and texel according to the polygon mode
+// where each component is 5 bits
+template <typename V>
+void SoftwareRenderer::shade_fragments(const PolygonSetup& setup, V& r, V& g, V& b, V& a, V texel) {
+    const auto mode = setup.polygon->polygon_attributes.polygon_mode;
+    const V tr = texel & 0x1f;
+    const V tg = (texel >> 5) & 0x1f;
+    const V tb = (texel >> 10) & 0x1f;
+    const V ta = (texel >> 15) & 0x1f;
+
+    auto modulate = [](V x, V y) {
+        return ((x + 1) * (y + 1) - 1) >> 5;
+    };
+
+    if (mode == Polygon::PolygonMode::Toon) {
+        const V toon = common::transform([this](u32 index) -> u32 {
+            return registers.toon_table[index & 0x1f];
+        }, r);
+
+        // in highlight mode the red component is used as a shade of grey and the toon colour gets added on afterwards
+        if (registers.disp3dcnt.polygon_shading) {
+            g = r;
+            b = r;
+        } else {
+            r = toon & 0x1f;
+            g = (toon >> 5) & 0x1f;
+            b = (toon >> 10) & 0x1f;
+        }
+
+        if (setup.texture) {
+            r = modulate(r, tr);
+            g = modulate(g, tg);
+            b = modulate(b, tb);
+            a = modulate(a, ta);
+        }
+
+        if (registers.disp3dcnt.polygon_shading) {
+            r = common::min<V>(r + (toon & 0x1f), common::splat<V>(31));
+            g = common::min<V>(g + ((toon >> 5) & 0x1f), common::splat<V>(31));
+            b = common::min<V>(b + ((toon >> 10) & 0x1f), common::splat<V>(31));
+        }
+    } else if (setup.texture) {
+        if (mode == Polygon::PolygonMode::Decal) {
+            // the texture is blended on top of the vertex colour using its alpha, while the polygon alpha is kept
+            r = common::divide_by_31(tr * ta + r * (31 - ta));
+            g = common::divide_by_31(tg * ta + g * (31 - ta));
+            b = common::divide_by_31(tb * ta + b * (31 - ta));
+        } else {
+            r = modulate(r, tr);
+            g = modulate(g, tg);
+            b = modulate(b, tb);
+            a = modulate(a, ta);
+        }
+    }
+}
+
+// runs the alpha test and then blends the fragments which passed into the buffers
+template <typename V>
+void SoftwareRenderer::draw_fragments(V pass, V depth, V r, V g, V b, V texel, V edge, u32 addr, int count, const PolygonSetup& setup) {
+    const auto& attributes = setup.polygon->polygon_attributes;
+    const auto& disp3dcnt = registers.disp3dcnt;
+    V a = common::splat<V>(setup.alpha);
+
+    shade_fragments(setup, r, g, b, a, texel);
+
+    // fragments with an alpha of 0 are never drawn
+    pass &= ~common::equal(a, common::splat<V>(0));
+    if (disp3dcnt.alpha_test) {
+        pass &= common::less_than(common::splat<V>(registers.alpha_test_ref & 0x1f), a);
+    }
+
+    const V old_colour = common::load<V>(&colour_buffer[addr], count);
+    const V old_depth = common::load<V>(&depth_buffer[addr], count);
+    const V old_attributes = common::load<V>(&attribute_buffer[addr], count);
+    const V opaque = common::equal(a, common::splat<V>(31));
+    const V id = common::splat<V>(attributes.id);
+
+    // translucent polygons don't get drawn over pixels from an earlier translucent polygon with the same id
+    pass &= opaque | ~common::equal(old_attributes & (TRANSLUCENT_ID | TRANSLUCENT), (id << 8) | TRANSLUCENT);
+
+    V colour = (a << 15) | (b << 10) | (g << 5) | r;
+
+    // translucent fragments get blended with whatever is behind them, unless nothing has been drawn there yet
+    if (disp3dcnt.alpha_blending) {
+        const V old_a = (old_colour >> 15) & 0x1f;
+        const V blended_r = (r * (a + 1) + (old_colour & 0x1f) * (31 - a)) >> 5;
+        const V blended_g = (g * (a + 1) + ((old_colour >> 5) & 0x1f) * (31 - a)) >> 5;
+        const V blended_b = (b * (a + 1) + ((old_colour >> 10) & 0x1f) * (31 - a)) >> 5;
+        const V blended = (common::max(a, old_a) << 15) | (blended_b << 10) | (blended_g << 5) | blended_r;
+        colour = common::select(opaque | common::equal(old_a, common::splat<V>(0)), colour, blended);
+    }
+
+    const V update_depth = attributes.translucent_depth ? common::splat<V>(0xffffffff) : opaque;
+    const V fog = common::splat<V>(attributes.fog_enable ? FOG : 0);
+    const V opaque_attributes = id | (edge & EDGE) | fog;
+    const V translucent_attributes = (old_attributes & (OPAQUE_ID | EDGE)) | (old_attributes & fog) | (id << 8) | TRANSLUCENT;
+
+    common::store(&colour_buffer[addr], common::select(pass, colour, old_colour), count);
+    common::store(&depth_buffer[addr], common::select(pass & update_depth, depth, old_depth), count);
+    common::store(&attribute_buffer[addr], common::select(pass, common::select(opaque, opaque_attributes, translucent_attributes), old_attributes), count);
+}
+
+u32 SoftwareRenderer::sample_texture(s16 s, s16 t, const TextureCache::Texture& texture, const Polygon::TextureAttributes::TextureParameters& parameters) {
+    const s32 width = texture.width;
+    const s32 height = texture.height;
+
+    // remove the fractional part
+    s32 u = s >> 4;
+    s32 v = t >> 4;
+
+    if (parameters.repeat_in_s_direction) {
+        if (parameters.flip_in_s_direction && (u & width)) {
+            u = (width - 1) - (u & (width - 1));
+        } else {
+            u &= width - 1;
+        }
+    } else {
+        u = std::clamp(u, 0, width - 1);
+    }
+
+    if (parameters.repeat_in_t_direction) {
+        if (parameters.flip_in_t_direction && (v & height)) {
+            v = (height - 1) - (v & (height - 1));
+        } else {
+            v &= height - 1;
+        }
+    } else {
+        v = std::clamp(v, 0, height - 1);
+    }
+
+    return texture.texels[(v * width) + u];
+}
+
+// pixels on the edge of an opaque polygon get the edge colour for their polygon id when they're
+// in front of a neighbouring pixel which belongs to a different polygon
+void SoftwareRenderer::mark_edges(int y) {
+    using common::u32x8;
+
+    // pad each scanline with the clear values, so that pixels off screen count as the rear plane
+    std::array<std::array<u32, 256 + 16>, 3> ids;
+    std::array<std::array<u32, 256 + 16>, 3> depths;
+
+    for (int row = 0; row < 3; row++) {
+        int line = y + row - 1;
+        ids[row].fill(clear_attributes & OPAQUE_ID);
+        depths[row].fill(clear_depth);
 
-            if (disp3dcnt.texture_mapping) {
-                framebuffer[addr] = decode_texture(s, t, polygon);
+        if (line >= 0 && line < 192) {
+            for (int x = 0; x < 256; x++) {
+                ids[row][x + 8] = attribute_buffer[(256 * line) + x] & OPAQUE_ID;
+                depths[row][x + 8] = depth_buffer[(256 * line) + x];
+            }
+        }
+    }
+
+    for (int x = 0; x < 256; x += 8) {
+        const u32 addr = (256 * y) + x;
+        const u32x8 attributes = common::load<u32x8>(&attribute_buffer[addr]);
+        const u32x8 id = attributes & OPAQUE_ID;
+        const u32x8 depth = common::load<u32x8>(&depths[1][x + 8]);
+
+        u32x8 mark = common::less_than(depth, common::load<u32x8>(&depths[0][x + 8])) & ~common::equal(id, common::load<u32x8>(&ids[0][x + 8]));
+        mark |= common::less_than(depth, common::load<u32x8>(&depths[2][x + 8])) & ~common::equal(id, common::load<u32x8>(&ids[2][x + 8]));
+        mark |= common::less_than(depth, common::load<u32x8>(&depths[1][x + 7])) & ~common::equal(id, common::load<u32x8>(&ids[1][x + 7]));
+        mark |= common::less_than(depth, common::load<u32x8>(&depths[1][x + 9])) & ~common::equal(id, common::load<u32x8>(&ids[1][x + 9]));
+        mark &= ~common::equal(attributes & EDGE, common::splat<u32x8>(0));
+
+        const u32x8 edge_colour = common::transform([this](u32 id) -> u32 {
+            return registers.edge_colour[id >> 3] & 0x7fff;
+        }, id);
+
+        const u32x8 colour = common::load<u32x8>(&colour_buffer[addr]);
+        common::store(&colour_buffer[addr], common::select(mark, (colour & ~0x7fff) | edge_colour, colour));
+    }
+}
+
+// blends each pixel with the fog colour based on its depth
+void SoftwareRenderer::apply_fog(int y) {
+    using common::u32x8;
+    const u32 fog_colour = (registers.fog_colour & 0x7fff) | (((registers.fog_colour >> 16) & 0x1f) << 15);
+    const bool alpha_only = registers.disp3dcnt.alpha_mode;
+
+    for (int x = 0; x < 256; x += 8) {
+        const u32 addr = (256 * y) + x;
+        const u32x8 attributes = common::load<u32x8>(&attribute_buffer[addr]);
+        const u32x8 depth = common::load<u32x8>(&depth_buffer[addr]);
+        const u32x8 colour = common::load<u32x8>(&colour_buffer[addr]);
+
+        // pixels without the fog flag get a density of 0, which leaves them unchanged
+        u32x8 density = common::transform([this](u32 depth) -> u32 {
+            return fog_density[std::min<u32>(depth >> 9, 0x7fff)];
+        }, depth);
+
+        density &= ~common::equal(attributes & FOG, common::splat<u32x8>(0));
+
+        u32x8 result{};
+        for (int shift = 0; shift < 20; shift += 5) {
+            const u32x8 component = (colour >> shift) & 0x1f;
+            const u32x8 fog_component = common::splat<u32x8>((fog_colour >> shift) & 0x1f);
+            const u32x8 blended = (fog_component * density + component * (128 - density)) >> 7;
+
+            if (alpha_only && shift != 15) {
+                result |= component << shift;
             } else {
-                framebuffer[addr] = c.to_u16();
+                result |= blended << shift;
             }
+        }
+
+        common::store(&colour_buffer[addr], result);
+    }
+}
+
+// converts the colour buffer into the final output and applies anti-aliasing
+void SoftwareRenderer::output_scanline(int y) {
+    using common::u32x8;
+    const bool anti_aliasing = registers.disp3dcnt.anti_aliasing;
+
+    for (int x = 0; x < 256; x += 8) {
+        const u32 addr = (256 * y) + x;
+        u32x8 colour = common::load<u32x8>(&colour_buffer[addr]);
+
+        // the real hardware blends edges using how much of each pixel the polygon covers, which isn't tracked,
+        // so instead average each edge pixel with the neighbouring pixel behind it
+        if (anti_aliasing) {
+            const u32x8 attributes = common::load<u32x8>(&attribute_buffer[addr]);
+            const u32x8 id = attributes & OPAQUE_ID;
+            const u32x8 depth = common::load<u32x8>(&depth_buffer[addr]);
+            const int left = x == 0 ? 0 : -1;
+            const int right = x == 248 ? 0 : 1;
+            u32x8 left_colour{};
+            u32x8 left_attributes{};
+            u32x8 left_depth{};
+            u32x8 right_colour{};
+            u32x8 right_attributes{};
+            u32x8 right_depth{};
+
+            for (int i = 0; i < 8; i++) {
+                int left_addr = addr + i + (i == 0 ? left : -1);
+                int right_addr = addr + i + (i == 7 ? right : 1);
+                left_colour[i] = colour_buffer[left_addr];
+                left_attributes[i] = attribute_buffer[left_addr];
+                left_depth[i] = depth_buffer[left_addr];
+                right_colour[i] = colour_buffer[right_addr];
+                right_attributes[i] = attribute_buffer[right_addr];
+                right_depth[i] = depth_buffer[right_addr];
+            }
+
+            const u32x8 use_left = ~common::equal(id, left_attributes & OPAQUE_ID) & common::less_than(depth, left_depth);
+            const u32x8 use_right = ~common::equal(id, right_attributes & OPAQUE_ID) & common::less_than(depth, right_depth);
+            const u32x8 apply = (use_left | use_right) & ~common::equal(attributes & (EDGE | TRANSLUCENT), common::splat<u32x8>(0)) & common::equal(attributes & TRANSLUCENT, common::splat<u32x8>(0));
+            const u32x8 behind = common::select(use_left, left_colour, right_colour);
 
-            depth_buffer[addr] = depth;
+            // average the rgb555 parts by dropping the lowest bit of each component
+            const u32x8 average = (colour & ~0x7fff) | ((((colour & 0x7bde) + (behind & 0x7bde)) >> 1) & 0x7fff);
+            colour = common::select(apply, average, colour);
         }
+
+        // pixels with an alpha of 0 let the layers behind the 3d layer show through
+        const u32x8 transparent = common::equal((colour >> 15) & 0x1f, common::splat<u32x8>(0));
+        common::store(&framebuffer[addr], common::select(transparent, common::splat<u32x8>(colour_transparent), colour & 0x7fff));
     }
 }
 
-bool SoftwareRenderer::depth_test(u32 old_depth, u32 depth, bool equal) {
-    if (equal) {
-        int margin = w_buffering ? 0xff : 0x200;
-        return std::abs(static_cast<s32>(depth) - static_cast<s32>(old_depth)) <= margin;
-    } else {
-        return depth < old_depth;
+// each fog table entry applies at depth fog_offset + (i + 1) * step,
+// with the density being interpolated between entries
+void SoftwareRenderer::build_fog_density_table() {
+    const u32 step = 0x400 >> registers.disp3dcnt.fog_depth_shift;
+    const s32 offset = registers.fog_offset & 0x7fff;
+
+    auto entry = [this](int i) -> u32 {
+        u32 density = (registers.fog_table[i / 4] >> ((i % 4) * 8)) & 0x7f;
+
+        // a density of 127 is treated as fully fogged
+        return density == 127 ? 128 : density;
+    };
+
+    for (int depth = 0; depth < 0x8000; depth++) {
+        const s32 position = depth - offset;
+
+        if (step == 0) {
+            fog_density[depth] = position < 0 ? entry(0) : entry(31);
+        } else if (position < static_cast<s32>(step)) {
+            fog_density[depth] = entry(0);
+        } else if (position >= static_cast<s32>(32 * step)) {
+            fog_density[depth] = entry(31);
+        } else {
+            const u32 i = (position / step) - 1;
+            const u32 fraction = position % step;
+            fog_density[depth] = ((entry(i) * (step - fraction)) + (entry(i + 1) * fraction)) / step;
+        }
     }
 }
 
-} // namespace
\ No newline at end of file
+} // namespace nds
\ No newline at end of file
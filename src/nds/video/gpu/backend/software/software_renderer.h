@@ -1,40 +1,161 @@
 #pragma once
 
 #include <array>
+#include <vector>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
 #include "common/types.h"
+#include "common/thread_pool.h"
 #include "nds/video/gpu/backend/renderer.h"
 #include "nds/video/gpu/backend/software/interpolator.h"
 #include "nds/video/gpu/backend/software/slope.h"
+#include "nds/video/gpu/backend/software/texture_cache.h"
 #include "nds/video/gpu/gpu.h"
 
 namespace nds {
 
 class SoftwareRenderer : public Renderer {
 public:
-    SoftwareRenderer(GPU::DISP3DCNT& disp3dcnt, VRAMRegion& texture_data, VRAMRegion& texture_palette);
+    SoftwareRenderer(const GPU::RenderRegisters& live_registers, VRAMRegion& texture_data, VRAMRegion& texture_palette, common::ThreadPool& thread_pool);
+    ~SoftwareRenderer();
 
     void reset() override;
     void render() override;
-    
-    u32* fetch_framebuffer() override { return framebuffer.data(); }
-
-    void submit_polygons(Polygon* polygons, int num_polygons, bool w_buffering) override;
+    void wait_for_render() override;
+    const u32* fetch_scanline(int line) override;
+    void submit_geometry(const GeometryBuffer& geometry) override;
 
 private:
-    void render_scanline(int y);
-    void render_polygon_scanline(Polygon& polygon, int y);
-    bool depth_test(u32 old_depth, u32 depth, bool equal);
-    u16 decode_texture(s16 s, s16 t, Polygon& polygon);
+    struct Edge {
+        const Vertex* v0{nullptr};
+        const Vertex* v1{nullptr};
+        Slope slope;
+    };
+
+    // per polygon state which stays the same across every scanline
+    struct PolygonSetup {
+        const Polygon* polygon{nullptr};
+        const TextureCache::Texture* texture{nullptr};
+        u32 alpha{0};
+        std::array<Edge, 10> left_edges;
+        std::array<Edge, 10> right_edges;
+        int num_left_edges{0};
+        int num_right_edges{0};
+
+        // the polygon covers scanlines top <= y < bottom
+        int top{0};
+        int bottom{0};
+    };
+
+    // the values at each end of a span, along with the part of it which is on screen
+    struct Span {
+        s32 start{0};
+        s32 end{0};
+        s32 x_start{0};
+        s32 x_end{0};
+        s32 w0{0};
+        s32 w1{0};
+        u32 z0{0};
+        u32 z1{0};
+        Colour c0;
+        Colour c1;
+        s16 s0{0};
+        s16 s1{0};
+        s16 t0{0};
+        s16 t1{0};
+
+        // pixels up to left_edge_end and from right_edge_start are part of the polygon's edges
+        s32 left_edge_end{0};
+        s32 right_edge_start{0};
+        bool edge_row{false};
+    };
+
+    // each pixel in the attribute buffer holds:
+    // bits 0-5: id of the opaque polygon
+    // bits 8-13: id of the last translucent polygon
+    // bit 16: set when the pixel lies on the edge of an opaque polygon
+    // bit 17: set when fog should be applied
+    // bit 18: set when a translucent polygon has been drawn
+    static constexpr u32 OPAQUE_ID = 0x3f;
+    static constexpr u32 TRANSLUCENT_ID = 0x3f << 8;
+    static constexpr u32 EDGE = 1 << 16;
+    static constexpr u32 FOG = 1 << 17;
+    static constexpr u32 TRANSLUCENT = 1 << 18;
+
+    void run_render_thread();
+    void render_frame();
+    void setup_polygons();
+    void setup_polygon(PolygonSetup& setup, const Polygon& polygon);
+    bool is_translucent(const Polygon& polygon);
+    void clear_band(int band);
+    void render_band(int band);
+    void finish_band(int band);
+    void render_polygon_scanline(const PolygonSetup& setup, int y);
+    void render_span(const Span& span, const PolygonSetup& setup, int y);
+    void render_span_simd(const Span& span, const PolygonSetup& setup, int y);
+
+    template <typename V>
+    void shade_fragments(const PolygonSetup& setup, V& r, V& g, V& b, V& a, V texel);
+
+    template <typename V>
+    void draw_fragments(V pass, V depth, V r, V g, V b, V texel, V edge, u32 addr, int count, const PolygonSetup& setup);
+
+    // post processing passes which work on a whole scanline at a time after every polygon has been drawn
+    void mark_edges(int y);
+    void apply_fog(int y);
+    void output_scanline(int y);
+    void build_fog_density_table();
+
+    const Edge& find_edge(const std::array<Edge, 10>& edges, int num_edges, int y);
+    u32 sample_texture(s16 s, s16 t, const TextureCache::Texture& texture, const Polygon::TextureAttributes::TextureParameters& parameters);
+
+    static constexpr u32 colour_transparent = 0x8000;
+    static constexpr int BAND_HEIGHT = 8;
+    static constexpr int NUM_BANDS = 192 / BAND_HEIGHT;
     
+    // the final output, in rgb555 with bit 15 set for transparent pixels
     std::array<u32, 256 * 192> framebuffer;
+
+    // colours are stored in the same format as decoded texels
+    std::array<u32, 256 * 192> colour_buffer;
     std::array<u32, 256 * 192> depth_buffer;
-    Polygon* polygons{nullptr};
+    std::array<u32, 256 * 192> attribute_buffer;
+
+    // the fog density (0 - 128) for each 15-bit depth value
+    std::array<u8, 0x8000> fog_density;
+
+    // values which every pixel gets reset to at the start of the frame
+    u32 clear_colour{0};
+    u32 clear_depth{0};
+    u32 clear_attributes{0};
+    const Polygon* polygons{nullptr};
     int num_polygons{0};
     bool w_buffering{false};
 
-    GPU::DISP3DCNT& disp3dcnt;
-    VRAMRegion& texture_data;
-    VRAMRegion& texture_palette;
+    // polygons which have been set up this frame, along with the indices
+    // of the polygons touching each band of scanlines in submission order
+    std::vector<PolygonSetup> setups;
+    std::array<std::vector<int>, NUM_BANDS> bins;
+
+    TextureCache texture_cache;
+
+    // the registers are latched at the start of each frame, so the cpu can keep writing to them
+    // while the frame is rendered on the render thread
+    GPU::RenderRegisters registers;
+    const GPU::RenderRegisters& live_registers;
+    common::ThreadPool& thread_pool;
+
+    // set once a scanline of the framebuffer has been fully written
+    std::array<std::atomic<bool>, 192> line_ready;
+
+    std::mutex render_mutex;
+    std::condition_variable render_requested;
+    std::condition_variable render_finished;
+    bool render_pending{false};
+    bool running{true};
+    std::thread render_thread;
 };
 
-} // namespace nds
\ No newline at end of file
+} // namespace nds
@@ -0,0 +1,119 @@
+#include "nds/video/gpu/backend/software/texture_cache.h"
+
+namespace nds {
+
+TextureCache::TextureCache(VRAMRegion& texture_data, VRAMRegion& texture_palette) : texture_data(texture_data), texture_palette(texture_palette) {}
+
+void TextureCache::reset() {
+    textures.clear();
+    decoded_bytes = 0;
+    frame = 0;
+}
+
+void TextureCache::begin_frame() {
+    if (decoded_bytes > MAX_DECODED_BYTES) {
+        // drop the textures which weren't used by the last frame first,
+        // and only flush everything if the ones still in use are over the limit
+        std::erase_if(textures, [this](const auto& entry) {
+            if (entry.second.validated_frame == frame) {
+                return false;
+            }
+
+            decoded_bytes -= get_size(entry.second);
+            return true;
+        });
+
+        if (decoded_bytes > MAX_DECODED_BYTES) {
+            textures.clear();
+            decoded_bytes = 0;
+        }
+    }
+
+    frame++;
+}
+
+const TextureCache::Texture* TextureCache::get(const Polygon::TextureAttributes& attributes) {
+    if (attributes.parameters.texture_format == Polygon::TextureFormat::None) {
+        return nullptr;
+    }
+
+    auto& texture = textures[get_key(attributes)];
+    if (texture.validated_frame == frame) {
+        return &texture;
+    }
+
+    u64 data_generation = get_data_generation(attributes);
+    u64 palette_generation = get_palette_generation(attributes);
+    if (texture.texels.empty() || texture.data_generation != data_generation || texture.palette_generation != palette_generation) {
+        decode(texture, attributes);
+        texture.data_generation = data_generation;
+        texture.palette_generation = palette_generation;
+    }
+
+    texture.validated_frame = frame;
+    return &texture;
+}
+
+u64 TextureCache::get_key(const Polygon::TextureAttributes& attributes) {
+    const auto& parameters = attributes.parameters;
+    u64 key = parameters.vram_offset;
+    key |= static_cast<u64>(parameters.width) << 16;
+    key |= static_cast<u64>(parameters.height) << 19;
+    key |= static_cast<u64>(parameters.texture_format) << 22;
+    key |= static_cast<u64>(parameters.colour0) << 25;
+
+    // direct colour textures don't use a palette
+    if (parameters.texture_format != Polygon::TextureFormat::Direct) {
+        key |= static_cast<u64>(attributes.palette_base & 0x1fff) << 26;
+    }
+
+    return key;
+}
+
+u64 TextureCache::get_data_generation(const Polygon::TextureAttributes& attributes) {
+    const auto& parameters = attributes.parameters;
+    const u32 address = parameters.vram_offset * 8;
+    const u32 texels = (8 << parameters.width) * (8 << parameters.height);
+
+    switch (parameters.texture_format) {
+    case Polygon::TextureFormat::Colour4:
+        return texture_data.get_generation(address, texels / 4);
+    case Polygon::TextureFormat::Colour16:
+        return texture_data.get_generation(address, texels / 2);
+    case Polygon::TextureFormat::Compressed: {
+        // the palette index data for each 4x4 tile is stored in slot 1
+        u32 slot_index = address >> 18;
+        u32 slot_offset = address & 0x1ffff;
+        u32 data_address = 0x20000 + (slot_offset / 2) + (slot_index * 0x10000);
+        return texture_data.get_generation(address, texels / 4) + texture_data.get_generation(data_address, texels / 8);
+    }
+    case Polygon::TextureFormat::Direct:
+        return texture_data.get_generation(address, texels * 2);
+    default:
+        return texture_data.get_generation(address, texels);
+    }
+}
+
+u64 TextureCache::get_palette_generation(const Polygon::TextureAttributes& attributes) {
+    const u32 palette_base = attributes.palette_base * 16;
+
+    switch (attributes.parameters.texture_format) {
+    case Polygon::TextureFormat::A3I5:
+        return texture_palette.get_generation(palette_base, 32 * 2);
+    case Polygon::TextureFormat::Colour4:
+        return texture_palette.get_generation(palette_base / 2, 4 * 2);
+    case Polygon::TextureFormat::Colour16:
+        return texture_palette.get_generation(palette_base, 16 * 2);
+    case Polygon::TextureFormat::Colour256:
+        return texture_palette.get_generation(palette_base, 256 * 2);
+    case Polygon::TextureFormat::Compressed:
+        // each tile can offset into the palette by up to 0x3fff * 4 bytes
+        return texture_palette.get_generation(palette_base, (0x3fff * 4) + (4 * 2));
+    case Polygon::TextureFormat::A5I3:
+        return texture_palette.get_generation(palette_base, 8 * 2);
+    default:
+        return 0;
+    }
+}
+
+} // namespace nds
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <unordered_map>
+#include <vector>
+#include "common/types.h"
+#include "nds/video/gpu/polygon.h"
+#include "nds/video/gpu/vertex.h"
+#include "nds/video/vram_region.h"
+
+namespace nds {
+
+// holds textures which have been fully decoded out of vram, so that sampling
+// them is just an array lookup
+// each texel is stored as rgb555 in bits 0-14 with a 5-bit alpha in bits 15-19,
+// where an alpha of 0 means the texel is transparent
+class TextureCache {
+public:
+    TextureCache(VRAMRegion& texture_data, VRAMRegion& texture_palette);
+
+    struct Texture {
+        std::vector<u32> texels;
+        u32 width{0};
+        u32 height{0};
+        u64 data_generation{0};
+        u64 palette_generation{0};
+        int validated_frame{-1};
+    };
+
+    void reset();
+
+    // textures only need to be checked against vram once per frame,
+    // since vram can't change while a frame is being rendered
+    // this is also where the cache gets trimmed, since no texture from the previous frame is still in use
+    void begin_frame();
+
+    // returns the decoded texture for the polygon, or nullptr if the polygon isn't textured
+    const Texture* get(const Polygon::TextureAttributes& attributes);
+
+private:
+    u64 get_key(const Polygon::TextureAttributes& attributes);
+    u64 get_data_generation(const Polygon::TextureAttributes& attributes);
+    u64 get_palette_generation(const Polygon::TextureAttributes& attributes);
+    void decode(Texture& texture, const Polygon::TextureAttributes& attributes);
+    u32 decode_texel(u32 s, u32 t, const Polygon::TextureAttributes& attributes);
+
+    u32 opaque(u16 colour) {
+        return (colour & 0x7fff) | (0x1f << 15);
+    }
+
+    u64 get_size(const Texture& texture) {
+        return texture.texels.size() * sizeof(u32);
+    }
+
+    // a single texture can take up to 4mb once decoded, so the cache is limited by the
+    // total size of its textures rather than how many there are
+    static constexpr u64 MAX_DECODED_BYTES = 64 * 1024 * 1024;
+
+    std::unordered_map<u64, Texture> textures;
+    u64 decoded_bytes{0};
+    int frame{0};
+
+    VRAMRegion& texture_data;
+    VRAMRegion& texture_palette;
+};
+
+} // namespace nds
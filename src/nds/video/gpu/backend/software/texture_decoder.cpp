@@ -1,81 +1,65 @@
-#include <algorithm>
-#include "common/logger.h"
-#include "nds/video/gpu/backend/software/software_renderer.h"
+#include "nds/video/gpu/backend/software/texture_cache.h"
 
 namespace nds {
 
-u16 SoftwareRenderer::decode_texture(s16 s, s16 t, Polygon& polygon) {
-    const auto& parameters = polygon.texture_attributes.parameters;
-    const u32 address = parameters.vram_offset * 8;
-    const u32 width = 8 << parameters.width;
-    const u32 height = 8 << parameters.height;
+void TextureCache::decode(Texture& texture, const Polygon::TextureAttributes& attributes) {
+    texture.width = 8 << attributes.parameters.width;
+    texture.height = 8 << attributes.parameters.height;
 
-    // remove the fractional part
-    s >>= 4;
-    t >>= 4;
+    decoded_bytes -= get_size(texture);
+    texture.texels.resize(texture.width * texture.height);
+    decoded_bytes += get_size(texture);
 
-    if (parameters.repeat_in_s_direction) {
-        if (parameters.flip_in_s_direction && (s & width)) {
-            s = (width - 1) - (s & (width - 1));
-        } else {
-            s &= width - 1;
+    for (u32 t = 0; t < texture.height; t++) {
+        for (u32 s = 0; s < texture.width; s++) {
+            texture.texels[(t * texture.width) + s] = decode_texel(s, t, attributes);
         }
-    } else {
-        s = std::clamp<u32>(s, 0, width);
-    }
-
-    if (parameters.repeat_in_t_direction) {
-        if (parameters.flip_in_t_direction && (t & height)) {
-            t = (height - 1) - (t & (height - 1));
-        } else {
-            t &= height - 1;
-        }
-    } else {
-        t = std::clamp<u32>(t, 0, height);
     }
+}
 
+u32 TextureCache::decode_texel(u32 s, u32 t, const Polygon::TextureAttributes& attributes) {
+    const auto& parameters = attributes.parameters;
+    const u32 address = parameters.vram_offset * 8;
+    const u32 width = 8 << parameters.width;
     const u32 offset = t * width + s;
-    u32 palette_base = polygon.texture_attributes.palette_base * 16;
-
-    // if (parameters.colour0) {
-    //     LOG_WARN("SoftwareRenderer: colour0 of paletted textures is transparent");
-    // }
+    u32 palette_base = attributes.palette_base * 16;
 
     switch (parameters.texture_format) {
     case Polygon::TextureFormat::None:
-        return 0x0000;
+        return 0;
     case Polygon::TextureFormat::A3I5: {
         int data = texture_data.read<u8>(address + offset);
         int index = data & 0x1f;
         int alpha = (data >> 5) & 0x7;
-        u16 colour = texture_palette.read<u16>(palette_base + index * 2) & 0x7fff;
+        u32 colour = texture_palette.read<u16>(palette_base + index * 2) & 0x7fff;
+
+        // expand the alpha from 3 bits to 5 bits
         alpha = (alpha * 4) + (alpha / 2);
-        colour |= alpha << 15;
-        return colour;
+        return colour | (alpha << 15);
     }
     case Polygon::TextureFormat::Colour4: {
         const int index = (texture_data.read<u8>(address + (offset / 4)) >> (2 * (offset & 0x3))) & 0x3;
         if (parameters.colour0 && index == 0) {
-            return 0x0000;
+            return 0;
         }
 
-        return texture_palette.read<u16>((palette_base >> 1) + index * 2) & 0x7fff;
+        return opaque(texture_palette.read<u16>((palette_base >> 1) + index * 2));
     }
     case Polygon::TextureFormat::Colour16: {
         const int index = (texture_data.read<u8>(address + (offset / 2)) >> (4 * (offset & 0x1))) & 0xf;
         if (parameters.colour0 && index == 0) {
-            return 0x0000;
+            return 0;
         }
         
-        return texture_palette.read<u16>(palette_base + index * 2) & 0x7fff;
+        return opaque(texture_palette.read<u16>(palette_base + index * 2));
     }
     case Polygon::TextureFormat::Colour256: {
         const int index = texture_data.read<u8>(address + offset);
         if (parameters.colour0 && index == 0) {
-            return 0x0000;
+            return 0;
         }
         
-        return texture_palette.read<u16>(palette_base + index * 2) & 0x7fff;
+        return opaque(texture_palette.read<u16>(palette_base + index * 2));
     }
     case Polygon::TextureFormat::Compressed: {
         // get the 2 bit texel
@@ -105,13 +89,13 @@ u16 SoftwareRenderer::decode_texture(s16 s, s16 t, Polygon& polygon) {
         switch (mode) {
         case 0:
             if (index == 3) {
-                return 0x0000;
+                return 0;
             }
 
-            return texture_palette.read<u16>(palette_base + index * 2) & 0x7fff;
+            return opaque(texture_palette.read<u16>(palette_base + index * 2));
         case 1:
             if (index == 3) {
-                return 0x0000;
+                return 0;
             }
 
             if (index == 2) {
@@ -123,12 +107,12 @@ u16 SoftwareRenderer::decode_texture(s16 s, s16 t, Polygon& polygon) {
                 c3.g = c1.g / 2 + c2.g / 2;
                 c3.b = c1.b / 2 + c2.b / 2;
 
-                return c3.to_u16();
+                return opaque(c3.to_u16());
             }
 
-            return texture_palette.read<u16>(palette_base + index * 2) & 0x7fff;
+            return opaque(texture_palette.read<u16>(palette_base + index * 2));
         case 2:
-            return texture_palette.read<u16>(palette_base + index * 2) & 0x7fff;
+            return opaque(texture_palette.read<u16>(palette_base + index * 2));
         default:
             if (index == 2 || index == 3) {
                 int c1_multiplier = index == 2 ? 5 : 3;
@@ -141,26 +125,31 @@ u16 SoftwareRenderer::decode_texture(s16 s, s16 t, Polygon& polygon) {
                 c3.g = (c1.g * c1_multiplier + c2.g * c2_multiplier) / 8;
                 c3.b = (c1.b * c1_multiplier + c2.b * c2_multiplier) / 8;
 
-                return c3.to_u16();
+                return opaque(c3.to_u16());
             }
 
-            return texture_palette.read<u16>(palette_base + index * 2) & 0x7fff;
+            return opaque(texture_palette.read<u16>(palette_base + index * 2));
         }
     }
     case Polygon::TextureFormat::A5I3: {
         int data = texture_data.read<u8>(address + offset);
         int index = data & 0x7;
         int alpha = data >> 3;
-        u16 colour = texture_palette.read<u16>(palette_base + index * 2);
-        alpha = (alpha * 4) + (alpha / 2);
-        colour |= alpha << 15;
-        return colour;
+        u32 colour = texture_palette.read<u16>(palette_base + index * 2) & 0x7fff;
+        return colour | (alpha << 15);
     }
     case Polygon::TextureFormat::Direct: {
-        const u32 texel_address = address + offset * 2;
-        return texture_data.read<u16>(texel_address);
+        // bit 15 decides if the texel is transparent or not
+        u16 colour = texture_data.read<u16>(address + offset * 2);
+        if (!(colour >> 15)) {
+            return 0;
+        }
+
+        return opaque(colour);
     }
     }
+
+    return 0;
 }
 
-} // namespace nds
\ No newline at end of file
+} // namespace nds
@@ -26,6 +26,8 @@ void GPU::pop_current_matrix() {
         texture.pop(offset);
         break;
     }
+
+    mark_clip_matrix_dirty();
 }
 
 void GPU::load_unit_matrix() {
@@ -46,6 +48,8 @@ void GPU::load_unit_matrix() {
         texture.current.reset();
         break;
     }
+
+    mark_clip_matrix_dirty();
 }
 
 void GPU::swap_buffers() {
@@ -104,6 +108,8 @@ void GPU::multiply_4x4() {
         texture.current = multiply_matrix_matrix(matrix, texture.current);
         break;
     }
+
+    mark_clip_matrix_dirty();
 }
 
 void GPU::multiply_4x3() {
@@ -130,6 +136,8 @@ void GPU::multiply_4x3() {
         texture.current = multiply_matrix_matrix(matrix, texture.current);
         break;
     }
+
+    mark_clip_matrix_dirty();
 }
 
 void GPU::push_current_matrix() {
@@ -171,6 +179,8 @@ void GPU::multiply_translation() {
         texture.current = multiply_matrix_matrix(matrix, texture.current);
         break;
     }
+
+    mark_clip_matrix_dirty();
 }
 
 void GPU::multiply_3x3() {
@@ -197,6 +207,8 @@ void GPU::multiply_3x3() {
         texture.current = multiply_matrix_matrix(matrix, texture.current);
         break;
     }
+
+    mark_clip_matrix_dirty();
 }
 
 void GPU::begin_vertex_list() {
@@ -278,6 +290,8 @@ void GPU::multiply_scale() {
         texture.current = multiply_matrix_matrix(matrix, texture.current);
         break;
     }
+
+    mark_clip_matrix_dirty();
 }
 
 void GPU::restore_current_matrix() {
@@ -296,6 +310,8 @@ void GPU::restore_current_matrix() {
         texture.restore(offset);
         break;
     }
+
+    mark_clip_matrix_dirty();
 }
 
 void GPU::add_vertex10() {
@@ -368,6 +384,8 @@ void GPU::load_4x4() {
         texture.current = matrix;
         break;
     }
+
+    mark_clip_matrix_dirty();
 }
 
 void GPU::set_light_vector() {
@@ -399,6 +417,8 @@ void GPU::load_4x3() {
         texture.current = matrix;
         break;
     }
+
+    mark_clip_matrix_dirty();
 }
 
 void GPU::set_vertex_xz() {
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <array>
+#include "common/types.h"
+#include "nds/video/gpu/vertex.h"
+#include "nds/video/gpu/polygon.h"
+
+namespace nds {
+
+// the vertex and polygon ram for a single frame
+// the geometry engine fills one buffer while the renderer reads the other, so once
+// a buffer has been submitted it stays untouched until the next swap and can be used without copying
+struct GeometryBuffer {
+    void reset() {
+        vertices.fill(Vertex{});
+        polygons.fill(Polygon{});
+        num_vertices = 0;
+        num_polygons = 0;
+        w_buffering = false;
+    }
+
+    std::array<Vertex, 6144> vertices;
+    std::array<Polygon, 2048> polygons;
+    int num_vertices{0};
+    int num_polygons{0};
+    bool w_buffering{false};
+};
+
+} // namespace nds
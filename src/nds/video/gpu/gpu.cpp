@@ -1,6 +1,7 @@
 #include <algorithm>
 #include "common/logger.h"
 #include "common/bits.h"
+#include "common/simd.h"
 #include "nds/video/gpu/gpu.h"
 #include "nds/video/gpu/backend/software/software_renderer.h"
 
@@ -24,6 +25,18 @@ static constexpr std::array<u8, 256> parameter_table = {{
     0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
 }};
 
+// how many cycles each command keeps the geometry engine busy for
+static constexpr std::array<u16, 256> cycle_table = {{
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    1, 17, 36, 17, 36, 19, 34, 30, 35, 31, 28, 22, 22, 0, 0, 0,
+    1, 9, 1, 9, 8, 8, 8, 8, 8, 1, 1, 1, 0, 0, 0, 0,
+    4, 4, 6, 1, 32, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    1, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    392, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    103, 9, 5, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+}};
+
 const char* get_command_name(u8 command) {
     switch (command) {
     case 0x00:
@@ -107,10 +120,13 @@ const char* get_command_name(u8 command) {
     }
 }
 
-GPU::GPU(common::Scheduler& scheduler, DMA& dma, IRQ& irq, VRAMRegion& texture_data, VRAMRegion& texture_palette) : scheduler(scheduler), dma(dma), irq(irq), texture_data(texture_data), texture_palette(texture_palette) {}
+GPU::GPU(common::Scheduler& scheduler, DMA& dma, IRQ& irq, VRAMRegion& texture_data, VRAMRegion& texture_palette, common::ThreadPool& thread_pool) : scheduler(scheduler), dma(dma), irq(irq), texture_data(texture_data), texture_palette(texture_palette), thread_pool(thread_pool) {}
 
 void GPU::reset() {
-    disp3dcnt.data = 0;
+    // the renderer could still be reading from the geometry buffers
+    wait_for_render();
+
+    render_registers.disp3dcnt.data = 0;
     gxstat.data = 0;
     gxfifo = 0;
     gxfifo_write_count = 0;
@@ -119,7 +135,7 @@ void GPU::reset() {
     gxstat.busy = false;
 
     geometry_command_event = scheduler.register_event("GeometryCommand", [this]() {
-        process_and_validate_command();
+        run_commands();
     });
 
     matrix_mode = MatrixMode::Projection;
@@ -129,26 +145,24 @@ void GPU::reset() {
     direction.reset();
     texture.reset();
     clip.reset();
+    clip_dirty = false;
 
-    for (int i = 0; i < 2; i++) {
-        vertex_ram[i].fill(Vertex{});
-        polygon_ram[i].fill(Polygon{});
+    for (auto& geometry_buffer : geometry_buffers) {
+        geometry_buffer.reset();
     }
 
-    vertex_ram_size = 0;
-    polygon_ram_size = 0;
     current_buffer = 0;
     swap_buffers_requested = false;
     w_buffering = false;
-    clear_colour = 0;
-    clear_depth = 0;
-    clrimage_offset = 0;
-    fog_colour = 0;
-    fog_offset = 0;
-    edge_colour.fill(0);
-    fog_table.fill(0);
-    toon_table.fill(0);
-    alpha_test_ref = 0;
+    render_registers.clear_colour = 0;
+    render_registers.clear_depth = 0;
+    render_registers.clrimage_offset = 0;
+    render_registers.fog_colour = 0;
+    render_registers.fog_offset = 0;
+    render_registers.edge_colour.fill(0);
+    render_registers.fog_table.fill(0);
+    render_registers.toon_table.fill(0);
+    render_registers.alpha_test_ref = 0;
 
     viewport.x0 = 0;
     viewport.y0 = 0;
@@ -160,11 +174,11 @@ void GPU::reset() {
     vertex_count = 0;
     polygon_count = 0;
 
-    renderer = std::make_unique<SoftwareRenderer>(disp3dcnt, texture_data, texture_palette);
+    renderer = std::make_unique<SoftwareRenderer>(render_registers, texture_data, texture_palette, thread_pool);
 }
 
 void GPU::write_disp3dcnt(u32 value, u32 mask) {
-    disp3dcnt.data = (disp3dcnt.data & ~mask) | (value & mask);
+    render_registers.disp3dcnt.data = (render_registers.disp3dcnt.data & ~mask) | (value & mask);
 }
 
 void GPU::write_gxfifo(u32 value) {
@@ -205,6 +219,11 @@ u32 GPU::read_gxstat() {
         value |= 1 << 26;
     }
 
+    // the geometry engine stays busy while a batch is running and while waiting for a buffer swap
+    if (gxstat.busy || swap_buffers_requested) {
+        value |= 1 << 27;
+    }
+
     value |= gxstat.fifo_irq << 30;
     return value;
 }
@@ -218,47 +237,50 @@ u32 GPU::read_clip_matrix(u32 addr) {
 }
 
 void GPU::write_gxstat(u32 value, u32 mask) {
+    // only the fifo irq mode can be written, the rest of gxstat is status
+    // (bit 15 acknowledges a matrix stack error, which isn't tracked yet)
+    mask &= 0xc0000000;
     gxstat.data = (gxstat.data & ~mask) | (value & mask);
     check_gxfifo_irq();
 }
 
 void GPU::write_clear_colour(u32 value, u32 mask) {
-    clear_colour = (clear_colour & ~mask) | (value & mask);
+    render_registers.clear_colour = (render_registers.clear_colour & ~mask) | (value & mask);
 }
 
 void GPU::write_clear_depth(u16 value, u32 mask) {
-    clear_depth = (clear_depth & ~mask) | (value & mask);
+    render_registers.clear_depth = (render_registers.clear_depth & ~mask) | (value & mask);
 }
 
 void GPU::write_clrimage_offset(u16 value, u32 mask) {
-    clrimage_offset = (clrimage_offset & ~mask) | (value & mask);
+    render_registers.clrimage_offset = (render_registers.clrimage_offset & ~mask) | (value & mask);
 }
 
 void GPU::write_fog_colour(u32 value, u32 mask) {
-    fog_colour = (fog_colour & ~mask) | (value & mask);
+    render_registers.fog_colour = (render_registers.fog_colour & ~mask) | (value & mask);
 }
 
 void GPU::write_fog_offset(u16 value, u32 mask) {
-    fog_offset = (fog_offset & ~mask) | (value & mask);
+    render_registers.fog_offset = (render_registers.fog_offset & ~mask) | (value & mask);
 }
 
 void GPU::write_edge_colour(u32 addr, u16 value) {
     const auto index = (addr >> 1) & 0x7;
-    edge_colour[index] = value;
+    render_registers.edge_colour[index] = value;
 }
 
 void GPU::write_fog_table(u32 addr, u32 value, u32 mask) {
     const auto index = (addr >> 2) & 0x7;
-    fog_table[index] = (fog_table[index] & ~mask) | (value & mask);
+    render_registers.fog_table[index] = (render_registers.fog_table[index] & ~mask) | (value & mask);
 }
 
 void GPU::write_toon_table(u32 addr, u16 value) {
     const auto index = (addr >> 1) & 0x1f;
-    toon_table[index] = value;
+    render_registers.toon_table[index] = value;
 }
 
 void GPU::write_alpha_test_ref(u8 value) {
-    alpha_test_ref = value;
+    render_registers.alpha_test_ref = value;
 }
 
 void GPU::queue_command(u32 addr, u32 data) {
@@ -271,26 +293,33 @@ void GPU::do_swap_buffers() {
         return;
     }
 
-    // normalise all the vertices
-    for (int i = 0; i < vertex_ram_size; i++) {
-        vertex_ram[current_buffer][i] = normalise_vertex(vertex_ram[current_buffer][i]);
-    }
+    // hand the finished buffer over to the renderer and start filling the other one
+    auto& geometry_buffer = geometry_buffers[current_buffer];
+    geometry_buffer.w_buffering = w_buffering;
+    renderer->submit_geometry(geometry_buffer);
 
-    renderer->submit_polygons(polygon_ram[current_buffer].data(), polygon_ram_size, w_buffering);
     swap_buffers_requested = false;
     current_buffer ^= 1;
-    vertex_ram_size = 0;
-    polygon_ram_size = 0;
+    geometry_buffers[current_buffer].num_vertices = 0;
+    geometry_buffers[current_buffer].num_polygons = 0;
 
     // Since the geometry engine was halted until this point,
     // resume command processing.
-    process_and_validate_command();
+    if (!gxstat.busy) {
+        run_commands();
+    }
 }
 
 void GPU::render() {
     renderer->render();
 }
 
+void GPU::wait_for_render() {
+    if (renderer) {
+        renderer->wait_for_render();
+    }
+}
+
 void GPU::check_gxfifo_irq() {
     if (gxstat.fifo_irq == InterruptType::LessThanHalfFull && fifo.get_size() < 128) {
         irq.raise(IRQ::Source::GXFIFO);
@@ -303,11 +332,17 @@ void GPU::queue_entry(Entry entry) {
     if (fifo.is_empty() && !pipe.is_full()) {
         pipe.push(entry);
     } else {
-        while (fifo.is_full()) {
-            // Run commands until the fifo isn't full.
-            gxstat.busy = false;
+        if (fifo.is_full()) {
+            // the cpu would stall until there's space in the fifo, so run commands
+            // straight away and start a new batch afterwards
             scheduler.cancel_event(&geometry_command_event);
-            process_command();
+            gxstat.busy = false;
+
+            while (fifo.is_full() && can_process_command()) {
+                process_command();
+            }
+
+            update_fifo_status();
         }
 
         fifo.push(entry);
@@ -315,7 +350,7 @@ void GPU::queue_entry(Entry entry) {
     }
 
     if (!gxstat.busy) {
-        process_and_validate_command();
+        run_commands();
     }
 }
 
@@ -332,45 +367,62 @@ GPU::Entry GPU::dequeue_entry() {
         if (!fifo.is_empty()) {
             pipe.push(fifo.pop());
         }
-
-        check_gxfifo_irq();
-
-        if (fifo.get_size() < 128) {
-            dma.set_gxfifo_half_empty(true);
-            dma.trigger(DMA::Timing::GXFIFO);
-        } else {
-            dma.set_gxfifo_half_empty(false);
-        }
     }
 
     return entry;
 }
 
-void GPU::process_and_validate_command() {
-    if (pipe.is_empty() || swap_buffers_requested) {
+void GPU::update_fifo_status() {
+    check_gxfifo_irq();
+
+    if (fifo.get_size() < 128) {
+        dma.set_gxfifo_half_empty(true);
+        dma.trigger(DMA::Timing::GXFIFO);
+    } else {
+        dma.set_gxfifo_half_empty(false);
+    }
+}
+
+void GPU::run_commands() {
+    // execute as many commands as fit into the batch back to back, and then
+    // stay busy until their total cost has elapsed
+    int cycles = 0;
+    int executed = 0;
+
+    while (cycles < BATCH_CYCLES && !swap_buffers_requested && can_process_command()) {
+        cycles += process_command();
+        executed++;
+    }
+
+    if (executed > 0) {
+        update_fifo_status();
+    }
+
+    if (cycles == 0) {
         gxstat.busy = false;
         return;
     }
 
-    process_command();
+    gxstat.busy = true;
+    scheduler.add_event(cycles, &geometry_command_event);
 }
 
-void GPU::process_command() {
+bool GPU::can_process_command() {
+    if (pipe.is_empty()) {
+        return false;
+    }
+
     const auto total_size = fifo.get_size() + pipe.get_size();
     const auto command = pipe.get_front().command;
-    const auto parameter_count = parameter_table[command];
+    return total_size >= parameter_table[command];
+}
 
-    if (total_size < parameter_count) {
-        gxstat.busy = false;
-        return;
-    }
+int GPU::process_command() {
+    const auto command = pipe.get_front().command;
+    const auto parameter_count = parameter_table[command];
 
     execute_command(command, parameter_count);
-
-    if (!swap_buffers_requested) {
-        gxstat.busy = true;
-        scheduler.add_event(1, &geometry_command_event);
-    }
+    return cycle_table[command];
 }
 
 void GPU::execute_command(u8 command, u8 parameter_count) {
@@ -491,14 +543,33 @@ void GPU::execute_command(u8 command, u8 parameter_count) {
 
 Matrix GPU::multiply_matrix_matrix(const Matrix& a, const Matrix& b) {
     Matrix multiplied_matrix;
-    for (int y = 0; y < 4; y++) {
-        for (int x = 0; x < 4; x++) {
-            s64 result = 0;
-            for (int i = 0; i < 4; i++) {
-                result += (static_cast<s64>(a.field[y][i]) * static_cast<s64>(b.field[i][x]));
+
+    if constexpr (common::simd_wide_multiply) {
+        // each row of the result is a sum of the rows of b weighted by a row of a,
+        // so work on whole rows at once with 64-bit lanes
+        std::array<common::s64x4, 4> rows;
+        for (int i = 0; i < 4; i++) {
+            rows[i] = common::load_wide(b.field[i].data());
+        }
+
+        for (int y = 0; y < 4; y++) {
+            common::s64x4 result = common::multiply_wide(rows[0], common::splat<common::s64x4>(a.field[y][0]));
+            for (int i = 1; i < 4; i++) {
+                result += common::multiply_wide(rows[i], common::splat<common::s64x4>(a.field[y][i]));
             }
 
-            multiplied_matrix.field[y][x] = result >> 12;
+            common::store(multiplied_matrix.field[y].data(), result >> 12);
+        }
+    } else {
+        for (int y = 0; y < 4; y++) {
+            for (int x = 0; x < 4; x++) {
+                s64 result = 0;
+                for (int i = 0; i < 4; i++) {
+                    result += (static_cast<s64>(a.field[y][i]) * static_cast<s64>(b.field[i][x]));
+                }
+
+                multiplied_matrix.field[y][x] = result >> 12;
+            }
         }
     }
 
@@ -507,20 +578,48 @@ Matrix GPU::multiply_matrix_matrix(const Matrix& a, const Matrix& b) {
 
 Vertex GPU::multiply_vertex_matrix(const Vertex& a, const Matrix& b) {
     Vertex multiplied_vertex = a;
-    multiplied_vertex.x = (static_cast<s64>(a.x) * b.field[0][0] + static_cast<s64>(a.y) * b.field[1][0] + static_cast<s64>(a.z) * b.field[2][0] + static_cast<s64>(a.w) * b.field[3][0]) >> 12;
-    multiplied_vertex.y = (static_cast<s64>(a.x) * b.field[0][1] + static_cast<s64>(a.y) * b.field[1][1] + static_cast<s64>(a.z) * b.field[2][1] + static_cast<s64>(a.w) * b.field[3][1]) >> 12;
-    multiplied_vertex.z = (static_cast<s64>(a.x) * b.field[0][2] + static_cast<s64>(a.y) * b.field[1][2] + static_cast<s64>(a.z) * b.field[2][2] + static_cast<s64>(a.w) * b.field[3][2]) >> 12;
-    multiplied_vertex.w = (static_cast<s64>(a.x) * b.field[0][3] + static_cast<s64>(a.y) * b.field[1][3] + static_cast<s64>(a.z) * b.field[2][3] + static_cast<s64>(a.w) * b.field[3][3]) >> 12;
+
+    if constexpr (common::simd_wide_multiply) {
+        common::s64x4 result = common::multiply_wide(common::load_wide(b.field[0].data()), common::splat<common::s64x4>(a.x));
+        result += common::multiply_wide(common::load_wide(b.field[1].data()), common::splat<common::s64x4>(a.y));
+        result += common::multiply_wide(common::load_wide(b.field[2].data()), common::splat<common::s64x4>(a.z));
+        result += common::multiply_wide(common::load_wide(b.field[3].data()), common::splat<common::s64x4>(a.w));
+        result >>= 12;
+
+        multiplied_vertex.x = result[0];
+        multiplied_vertex.y = result[1];
+        multiplied_vertex.z = result[2];
+        multiplied_vertex.w = result[3];
+    } else {
+        multiplied_vertex.x = (static_cast<s64>(a.x) * b.field[0][0] + static_cast<s64>(a.y) * b.field[1][0] + static_cast<s64>(a.z) * b.field[2][0] + static_cast<s64>(a.w) * b.field[3][0]) >> 12;
+        multiplied_vertex.y = (static_cast<s64>(a.x) * b.field[0][1] + static_cast<s64>(a.y) * b.field[1][1] + static_cast<s64>(a.z) * b.field[2][1] + static_cast<s64>(a.w) * b.field[3][1]) >> 12;
+        multiplied_vertex.z = (static_cast<s64>(a.x) * b.field[0][2] + static_cast<s64>(a.y) * b.field[1][2] + static_cast<s64>(a.z) * b.field[2][2] + static_cast<s64>(a.w) * b.field[3][2]) >> 12;
+        multiplied_vertex.w = (static_cast<s64>(a.x) * b.field[0][3] + static_cast<s64>(a.y) * b.field[1][3] + static_cast<s64>(a.z) * b.field[2][3] + static_cast<s64>(a.w) * b.field[3][3]) >> 12;
+    }
+
     return multiplied_vertex;
 }
 
 void GPU::update_clip_matrix() {
+    // the clip matrix only needs to be recalculated after the modelview or projection matrix changes
+    if (!clip_dirty) {
+        return;
+    }
+
     clip = multiply_matrix_matrix(modelview.current, projection.current);
+    clip_dirty = false;
+}
+
+void GPU::mark_clip_matrix_dirty() {
+    // the texture matrix isn't part of the clip matrix
+    if (matrix_mode != MatrixMode::Texture) {
+        clip_dirty = true;
+    }
 }
 
 void GPU::submit_vertex() {
-    if (vertex_ram_size >= 6144) {
-        disp3dcnt.polygon_vertex_ram_overflow = true;
+    if (geometry_buffers[current_buffer].num_vertices >= 6144) {
+        render_registers.disp3dcnt.polygon_vertex_ram_overflow = true;
         return;
     }
 
@@ -583,8 +682,10 @@ void GPU::submit_polygon() {
         vertex_count = 0;
     }
 
-    if (polygon_ram_size >= 2048) {
-        disp3dcnt.polygon_vertex_ram_overflow = true;
+    auto& geometry_buffer = geometry_buffers[current_buffer];
+
+    if (geometry_buffer.num_polygons >= 2048) {
+        render_registers.disp3dcnt.polygon_vertex_ram_overflow = true;
         return;
     }
 
@@ -592,21 +693,18 @@ void GPU::submit_polygon() {
         return;
     }
 
-    auto& vertex_ram = this->vertex_ram[current_buffer];
-    auto& polygon_ram = this->polygon_ram[current_buffer];
-
-    // TODO: implement clipping
+    // strips share vertices with the next polygon, so clip a copy of the vertex list
+    std::array<Vertex, 10> vertices;
     int size = 3 + (static_cast<int>(polygon_type) & 0x1);
+    std::copy(vertex_list.begin(), vertex_list.begin() + size, vertices.begin());
 
-    // by this point the polygon will have been clipped and culled,
-    // so we can add the vertices of the vertex list to vertex ram
-    for (int i = 0; i < size; i++) {
-        if (vertex_ram_size >= 6144) {
-            disp3dcnt.polygon_vertex_ram_overflow = true;
-            return;
-        }
+    if (!clip_polygon(vertices, size)) {
+        return;
+    }
 
-        vertex_ram[vertex_ram_size++] = vertex_list[i];
+    if (geometry_buffer.num_vertices + size > 6144) {
+        render_registers.disp3dcnt.polygon_vertex_ram_overflow = true;
+        return;
     }
 
     // now construct the polygon
@@ -614,19 +712,101 @@ void GPU::submit_polygon() {
     Polygon polygon;
     polygon.texture_attributes = current_polygon.texture_attributes;
     polygon.polygon_attributes = current_polygon.polygon_attributes;
-
-    // TODO: eventually size should account for potential vertices that were added from clipping
     polygon.size = size;
-
     polygon.vertices.fill(nullptr);
 
-    // make the polygon vertices point to the vertices we just added to vertex ram
-    for (int i = 0; i < polygon.size; i++) {
-        polygon.vertices[i] = &vertex_ram[vertex_ram_size - size + i];
+    // the clipped vertices are converted to screen coordinates with the current viewport
+    // and added to vertex ram, with the polygon pointing to them
+    for (int i = 0; i < size; i++) {
+        auto& vertex = geometry_buffer.vertices[geometry_buffer.num_vertices++];
+        vertex = normalise_vertex(vertices[i]);
+        polygon.vertices[i] = &vertex;
     }
 
     // submit the polygon to polygon ram
-    polygon_ram[polygon_ram_size++] = polygon;
+    geometry_buffer.polygons[geometry_buffer.num_polygons++] = polygon;
+}
+
+// clips the polygon against each plane of the view volume (-w <= x, y, z <= w) using the sutherland-hodgman algorithm,
+// where each plane can add at most 1 vertex
+// returns false if the polygon should be discarded
+bool GPU::clip_polygon(std::array<Vertex, 10>& vertices, int& size) {
+    auto get_coordinate = [](const Vertex& vertex, int axis) -> s64 {
+        switch (axis) {
+        case 0:
+            return vertex.x;
+        case 1:
+            return vertex.y;
+        default:
+            return vertex.z;
+        }
+    };
+
+    for (int axis = 0; axis < 3; axis++) {
+        for (int sign : {1, -1}) {
+            // the distance of a vertex from the plane, where vertices inside have a distance >= 0
+            auto distance = [&](const Vertex& vertex) -> s64 {
+                return static_cast<s64>(vertex.w) - sign * get_coordinate(vertex, axis);
+            };
+
+            std::array<Vertex, 10> clipped;
+            int clipped_size = 0;
+
+            for (int i = 0; i < size; i++) {
+                const auto& current = vertices[i];
+                const auto& previous = vertices[i == 0 ? size - 1 : i - 1];
+                const s64 current_distance = distance(current);
+                const s64 previous_distance = distance(previous);
+
+                if (current_distance >= 0) {
+                    if (previous_distance < 0) {
+                        clipped[clipped_size++] = clip_edge(current, previous, current_distance, previous_distance);
+                    }
+
+                    clipped[clipped_size++] = current;
+                } else if (previous_distance >= 0) {
+                    clipped[clipped_size++] = clip_edge(previous, current, previous_distance, current_distance);
+                }
+            }
+
+            // polygons crossing the far plane are hidden entirely unless clip_far_plane is set
+            const bool far_plane = axis == 2 && sign == 1;
+            if (far_plane && clipped_size != size && !current_polygon.polygon_attributes.clip_far_plane) {
+                return false;
+            }
+
+            if (clipped_size == 0) {
+                return false;
+            }
+
+            vertices = clipped;
+            size = clipped_size;
+        }
+    }
+
+    return true;
+}
+
+// finds where the edge between 2 vertices crosses a plane, interpolating every attribute
+Vertex GPU::clip_edge(const Vertex& inside, const Vertex& outside, s64 inside_distance, s64 outside_distance) {
+    const s64 numerator = inside_distance;
+    const s64 denominator = inside_distance - outside_distance;
+
+    auto interpolate = [&](s64 a, s64 b) -> s64 {
+        return a + ((b - a) * numerator) / denominator;
+    };
+
+    Vertex vertex;
+    vertex.x = interpolate(inside.x, outside.x);
+    vertex.y = interpolate(inside.y, outside.y);
+    vertex.z = interpolate(inside.z, outside.z);
+    vertex.w = interpolate(inside.w, outside.w);
+    vertex.colour.r = interpolate(inside.colour.r, outside.colour.r);
+    vertex.colour.g = interpolate(inside.colour.g, outside.colour.g);
+    vertex.colour.b = interpolate(inside.colour.b, outside.colour.b);
+    vertex.s = interpolate(inside.s, outside.s);
+    vertex.t = interpolate(inside.t, outside.t);
+    return vertex;
 }
 
 Vertex GPU::normalise_vertex(const Vertex& vertex) {
@@ -5,11 +5,13 @@
 #include "common/types.h"
 #include "common/ring_buffer.h"
 #include "common/scheduler.h"
+#include "common/thread_pool.h"
 #include "nds/hardware/dma.h"
 #include "nds/video/vram_region.h"
 #include "nds/video/gpu/matrix_stack.h"
 #include "nds/video/gpu/vertex.h"
 #include "nds/video/gpu/polygon.h"
+#include "nds/video/gpu/geometry_buffer.h"
 #include "nds/video/gpu/backend/renderer.h"
 #include "nds/hardware/irq.h"
 
@@ -17,12 +19,12 @@ namespace nds {
 
 class GPU {
 public:
-    GPU(common::Scheduler& scheduler, DMA& dma, IRQ& irq, VRAMRegion& texture_data, VRAMRegion& texture_palette);
+    GPU(common::Scheduler& scheduler, DMA& dma, IRQ& irq, VRAMRegion& texture_data, VRAMRegion& texture_palette, common::ThreadPool& thread_pool);
 
     void reset();
-    u32* fetch_framebuffer() { return renderer->fetch_framebuffer(); };
+    const u32* fetch_scanline(int line) { return renderer->fetch_scanline(line); }
 
-    u32 read_disp3dcnt() const { return disp3dcnt.data; }
+    u32 read_disp3dcnt() const { return render_registers.disp3dcnt.data; }
     void write_disp3dcnt(u32 value, u32 mask);
     void write_gxfifo(u32 value);
 
@@ -41,6 +43,7 @@ public:
     void queue_command(u32 addr, u32 data);
     void do_swap_buffers();
     void render();
+    void wait_for_render();
 
     union DISP3DCNT {
         struct {
@@ -62,8 +65,22 @@ public:
         u32 data;
     };
 
-    DISP3DCNT disp3dcnt;
-    
+    // registers which control how the rendering engine draws the scene
+    struct RenderRegisters {
+        DISP3DCNT disp3dcnt;
+        u32 clear_colour{0};
+        u16 clear_depth{0};
+        u16 clrimage_offset{0};
+        u32 fog_colour{0};
+        u16 fog_offset{0};
+        std::array<u16, 8> edge_colour;
+        std::array<u32, 8> fog_table;
+        std::array<u16, 32> toon_table;
+        u8 alpha_test_ref{0};
+    };
+
+    RenderRegisters render_registers;
+
 private:
     struct Entry {
         u8 command{0};
@@ -87,16 +104,21 @@ private:
     void check_gxfifo_irq();
     void queue_entry(Entry entry);
     Entry dequeue_entry();
-    void process_and_validate_command();
-    void process_command();
+    void update_fifo_status();
+    void run_commands();
+    bool can_process_command();
+    int process_command();
     void execute_command(u8 command, u8 parameter_count);
 
     Matrix multiply_matrix_matrix(const Matrix& a, const Matrix& b);
     Vertex multiply_vertex_matrix(const Vertex& a, const Matrix& b);
 
     void update_clip_matrix();
+    void mark_clip_matrix_dirty();
     void submit_vertex();
     void submit_polygon();
+    bool clip_polygon(std::array<Vertex, 10>& vertices, int& size);
+    Vertex clip_edge(const Vertex& inside, const Vertex& outside, s64 inside_distance, s64 outside_distance);
     Vertex normalise_vertex(const Vertex& vertex);
     bool cull(const Vertex& v0, const Vertex& v1, const Vertex& v2);
 
@@ -170,6 +192,9 @@ private:
     common::RingBuffer<Entry, 4> pipe;
     
     common::EventType geometry_command_event;
+
+    // the most cycles worth of commands which get executed in a single batch
+    static constexpr int BATCH_CYCLES = 512;
     MatrixMode matrix_mode{MatrixMode::Projection};
 
     MatrixStack<1> projection;
@@ -178,10 +203,10 @@ private:
     MatrixStack<1> texture;
     Matrix clip;
 
-    std::array<std::array<Vertex, 6144>, 2> vertex_ram;
-    int vertex_ram_size{0};
-    std::array<std::array<Polygon, 2048>, 2> polygon_ram;
-    int polygon_ram_size{0};
+    // set when the modelview or projection matrix changes
+    bool clip_dirty{false};
+
+    std::array<GeometryBuffer, 2> geometry_buffers;
 
     // tracks which vertex/polygon ram is currently being used
     int current_buffer{0};
@@ -189,16 +214,6 @@ private:
     bool swap_buffers_requested{false};
     bool w_buffering{false};
 
-    u32 clear_colour{0};
-    u16 clear_depth{0};
-    u16 clrimage_offset{0};
-    u32 fog_colour{0};
-    u16 fog_offset{0};
-    std::array<u16, 8> edge_colour;
-    std::array<u32, 8> fog_table;
-    std::array<u16, 32> toon_table;
-    u8 alpha_test_ref{0};
-
     Vertex current_vertex;
     Polygon current_polygon;
 
@@ -223,6 +238,7 @@ private:
     IRQ& irq;
     VRAMRegion& texture_data;
     VRAMRegion& texture_palette;
+    common::ThreadPool& thread_pool;
 };
 
 } // namespace nds
\ No newline at end of file
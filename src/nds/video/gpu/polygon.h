@@ -1,5 +1,6 @@
 #pragma once
 
+#include <array>
 #include "common/types.h"
 #include "nds/video/gpu/vertex.h"
 
@@ -7,7 +8,7 @@ namespace nds {
 
 class Polygon {
 public:
-    int next(int current) {
+    int next(int current) const {
         if (current == size - 1) {
             return 0;
         } else {
@@ -15,7 +16,7 @@ public:
         }
     }
 
-    int prev(int current) {
+    int prev(int current) const {
         if (current == 0) {
             return size - 1;
         } else {
@@ -20,14 +20,6 @@ public:
         this->b = b;
     }
 
-    // converts to 8 bit precision and returns as hex
-    u32 to_u32() {
-        u8 new_b = (b * 255) / 31;
-        u8 new_g = (g * 255) / 31;
-        u8 new_r = (r * 255) / 31;
-        return (new_b << 16) | (new_g << 8) | new_r;
-    }
-
     u16 to_u16() {
         return (b << 10) | (g << 5) | r;
     }
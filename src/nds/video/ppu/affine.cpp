@@ -6,38 +6,61 @@
 
 namespace nds {
 
-void PPU::affine_loop(int id, int width, int height, AffineCallback affine_callback) {
+// picks a version of the affine loop with the wraparound and mosaic checks resolved at compile time
+// fetch returns the colour of the texel at (x, y), which is always within the background
+template <typename Fetch>
+void PPU::render_affine_layer(int id, int width, int height, Fetch fetch) {
+    bool mosaic_enabled = bgcnt[id].mosaic && mosaic.bg_width != 0;
+
+    if (bgcnt[id].wraparound_ext_palette_slot) {
+        if (mosaic_enabled) {
+            affine_loop<true, true>(id, width, height, fetch);
+        } else {
+            affine_loop<true, false>(id, width, height, fetch);
+        }
+    } else {
+        if (mosaic_enabled) {
+            affine_loop<false, true>(id, width, height, fetch);
+        } else {
+            affine_loop<false, false>(id, width, height, fetch);
+        }
+    }
+}
+
+template <bool wraparound, bool mosaic_enabled, typename Fetch>
+void PPU::affine_loop(int id, int width, int height, Fetch fetch) {
     s32 copy_x = internal_x[id - 2];
     s32 copy_y = internal_y[id - 2];
+    s32 step_x = bgpa[id - 2];
+    s32 step_y = bgpc[id - 2];
     int mosaic_bg_horizontal_counter = 0;
+    auto& layer = bg_layers[id];
 
     for (int pixel = 0; pixel < 256; pixel++) {
         int x = copy_x >> 8;
         int y = copy_y >> 8;
 
         // apply horizontal mosaic
-        if (bgcnt[id].mosaic && mosaic.bg_width != 0) {
+        if constexpr (mosaic_enabled) {
             if (mosaic_bg_horizontal_counter == mosaic.bg_width) {
                 mosaic_bg_horizontal_counter = 0;
-                copy_x += mosaic.bg_width * bgpa[id - 2];
-                copy_y += mosaic.bg_width * bgpc[id - 2];
+                copy_x += mosaic.bg_width * step_x;
+                copy_y += mosaic.bg_width * step_y;
             } else {
                 mosaic_bg_horizontal_counter++;
             }
         } else {
-            copy_x += bgpa[id - 2];
-            copy_y += bgpc[id - 2];
+            copy_x += step_x;
+            copy_y += step_y;
         }
 
-        if (bgcnt[id].wraparound_ext_palette_slot) {
-            x &= width - 1;
-            y &= height - 1;
+        if constexpr (wraparound) {
+            layer[pixel] = fetch(x & (width - 1), y & (height - 1));
         } else if (x < 0 || x >= width || y < 0 || y >= height) {
-            bg_layers[id][pixel] = colour_transparent;
-            continue;
+            layer[pixel] = colour_transparent;
+        } else {
+            layer[pixel] = fetch(x, y);
         }
-
-        affine_callback(pixel, x, y);
     }
 }
 
@@ -46,23 +69,20 @@ void PPU::render_affine(int id) {
     u32 character_base = (bgcnt[id].character_base * 16384) + (dispcnt.character_base * 65536);
     int size = 128 << bgcnt[id].size;
 
-    affine_loop(id, size, size, [&](int pixel, int x, int y) {
-        auto row = y % 8;
-        auto column = x % 8;
+    update_bg_palettes();
+    const u16* palette = bg_palette_8bpp.data();
+
+    render_affine_layer(id, size, size, [&](int x, int y) -> u16 {
         u32 screen_addr = screen_base + (y / 8) * (size / 8) + (x / 8);
         u8 tile_number = bg.read<u8>(screen_addr);
-        u32 tile_addr = character_base + (tile_number * 64) + (row * 8) + column;
-        u8 palette_index = bg.read<u8>(tile_addr);
-        
-        if (palette_index == 0) {
-            bg_layers[id][pixel] = colour_transparent;
-        } else {
-            bg_layers[id][pixel] = common::read<u16>(palette_ram, (palette_index * 2) & 0x3ff);
-        }
+        u32 tile_addr = character_base + (tile_number * 64) + ((y % 8) * 8) + (x % 8);
+        return palette[bg.read<u8>(tile_addr)];
     });
 }
 
 void PPU::render_extended(int id) {
+    update_bg_palettes();
+
     if (common::get_bit<7>(bgcnt[id].data)) {
         u32 data_base = bgcnt[id].screen_base * 16384;
         int bitmap_width = extended_dimensions[bgcnt[id].size][0];
@@ -70,27 +90,15 @@ void PPU::render_extended(int id) {
 
         if (common::get_bit<2>(bgcnt[id].data)) {
             // direct colour bitmap
-            affine_loop(id, bitmap_width, bitmap_height, [&](int pixel, int x, int y) {
-                u32 data_addr = data_base + (y * bitmap_width + x) * 2;
-                u16 colour = bg.read<u16>(data_addr);
-
-                if ((colour >> 15) & 0x1) {
-                    bg_layers[id][pixel] = colour;
-                } else {
-                    bg_layers[id][pixel] = colour_transparent;
-                }
+            render_affine_layer(id, bitmap_width, bitmap_height, [&](int x, int y) -> u16 {
+                u16 colour = bg.read<u16>(data_base + (y * bitmap_width + x) * 2);
+                return (colour & 0x8000) ? colour : colour_transparent;
             });
         } else {
             // 256 colour bitmap
-            affine_loop(id, bitmap_width, bitmap_height, [&](int pixel, int x, int y) {
-                u32 data_addr = data_base + (y * bitmap_width) + x;
-                u8 palette_index = bg.read<u8>(data_addr);
-
-                if (palette_index == 0) {
-                    bg_layers[id][pixel] = colour_transparent;
-                } else {
-                    bg_layers[id][pixel] = common::read<u16>(palette_ram, (palette_index * 2) & 0x3FF);
-                }
+            const u16* palette = bg_palette_8bpp.data();
+            render_affine_layer(id, bitmap_width, bitmap_height, [&](int x, int y) -> u16 {
+                return palette[bg.read<u8>(data_base + (y * bitmap_width) + x)];
             });
         }
     } else {
@@ -99,27 +107,24 @@ void PPU::render_extended(int id) {
         u32 character_base = (bgcnt[id].character_base * 16384) + (dispcnt.character_base * 65536);
         int size = 128 << bgcnt[id].size;
 
-        affine_loop(id, size, size, [&](int pixel, int x, int y) {
+        // extended palette slots 2 and 3 always belong to bg2 and bg3 here,
+        // since the slot bit of bgcnt is used for wraparound instead
+        bool extended_palette = dispcnt.bg_extended_palette;
+        const u16* palette = extended_palette ? get_bg_extended_palette(id) : bg_palette_8bpp.data();
+
+        render_affine_layer(id, size, size, [&](int x, int y) -> u16 {
             u32 screen_addr = screen_base + ((y / 8) * (size / 8) + (x / 8)) * 2;
             u16 tile_info = bg.read<u16>(screen_addr);
-            int tile_number = tile_info & 0x3ff;
-            bool horizontal_flip = (tile_info >> 10) & 0x1;
-            bool vertical_flip = (tile_info >> 11) & 0x1;
-            int palette_number = (tile_info >> 12) & 0xf;
+            int tile_number = common::get_field<0, 10>(tile_info);
+            bool horizontal_flip = common::get_bit<10>(tile_info);
+            bool vertical_flip = common::get_bit<11>(tile_info);
+            int palette_number = common::get_field<12, 4>(tile_info);
 
             int row = (vertical_flip ? (y ^ 7) : y) % 8;
             int column = (horizontal_flip ? (x ^ 7) : x) % 8;
             u32 tile_addr = character_base + (tile_number * 64) + (row * 8) + column;
             u8 palette_index = bg.read<u8>(tile_addr);
-            
-            if (palette_index == 0) {
-                bg_layers[id][pixel] = colour_transparent;
-            } else if (dispcnt.bg_extended_palette) {
-                u32 extended_palette_addr = (id * 8192) + ((palette_number * 256) + palette_index) * 2;
-                bg_layers[id][pixel] = bg_extended_palette.read<u16>(extended_palette_addr);
-            } else {
-                bg_layers[id][pixel] = common::read<u16>(palette_ram, (palette_index * 2) & 0x3ff);
-            }
+            return extended_palette ? palette[(palette_number * 256) + palette_index] : palette[palette_index];
         });
     }
 }
@@ -128,16 +133,12 @@ void PPU::render_large(int id) {
     int bitmap_width = 512 << (bgcnt[id].size & 0x1);
     int bitmap_height = 1024 >> (bgcnt[id].size & 0x1);
 
-    affine_loop(id, bitmap_width, bitmap_height, [&](int pixel, int x, int y) {
-        u32 tile_addr = (y * bitmap_width) + x;
-        u8 palette_index = bg.read<u8>(tile_addr);
-        
-        if (palette_index == 0) {
-            bg_layers[id][pixel] = colour_transparent;
-        } else {
-            bg_layers[id][pixel] = common::read<u16>(palette_ram, (palette_index * 2) & 0x3ff);
-        }
+    update_bg_palettes();
+    const u16* palette = bg_palette_8bpp.data();
+
+    render_affine_layer(id, bitmap_width, bitmap_height, [&](int x, int y) -> u16 {
+        return palette[bg.read<u8>((y * bitmap_width) + x)];
     });
 }
 
-} // namespace nds
\ No newline at end of file
+} // namespace nds
@@ -2,160 +2,148 @@
 #include <algorithm>
 #include "common/logger.h"
 #include "common/memory.h"
+#include "common/simd.h"
+#include "common/colour.h"
 #include "nds/video/ppu/ppu.h"
 
 namespace nds {
 
 void PPU::compose_scanline(int line) {
-    for (int x = 0; x < 256; x++) {
-        bool blending = bldcnt.special_effect != SpecialEffect::None || line_has_semi_transparent_obj;
-        if (blending) {
-            compose_pixel_with_special_effects(x, line);
-        } else {
-            compose_pixel(x, line);
-        }
-    }
-}
-
-void PPU::compose_pixel(int x, int line) {
-    u8 enabled = calculate_enabled_layers(x, line);
-    u16 backdrop = common::read<u16>(palette_ram);
-    u16 pixel = backdrop;
-    int priority = 4;
+    calculate_window_mask(line);
 
-    for (int i = 3; i >= 0; i--) {
-        if (((enabled >> i) & 0x1) && bgcnt[i].priority <= priority) {
-            u16 bg_pixel = bg_layers[i][x];
-            if (bg_pixel != colour_transparent) {
-                pixel = bg_pixel;
-                priority = bgcnt[i].priority;
-            }
+    bool blending = bldcnt.special_effect != SpecialEffect::None || line_has_semi_transparent_obj;
+    if constexpr (common::simd_accelerated) {
+        for (int x = 0; x < 256; x += common::lanes<common::u32x8>()) {
+            compose_pixels<common::u32x8>(x, line, blending);
         }
-    }
-
-    if (dispcnt.enable_obj && obj_buffer[x].colour != colour_transparent) {
-        if (obj_buffer[x].priority <= priority) {
-            pixel = obj_buffer[x].colour;
+    } else {
+        for (int x = 0; x < 256; x++) {
+            compose_pixels<u32>(x, line, blending);
         }
     }
-
-    plot(x, line, rgb555_to_rgb666(pixel));
 }
 
-void PPU::compose_pixel_with_special_effects(int x, int line) {
-    u8 enabled = calculate_enabled_layers(x, line);
-    u16 backdrop = common::read<u16>(palette_ram);
-    std::array<int, 2> targets;
-    std::array<int, 2> priorities;
-
-    targets.fill(5);
-    priorities.fill(4);
-
-    bool is_semi_transparent = false;
-    
-    // find the 2 top-most background pixels
+// composes lanes<V>() pixels starting at x, by finding the top 2 layers at each pixel
+// and then applying the colour special effects to them
+template <typename V>
+void PPU::compose_pixels(int x, int line, bool blending) {
+    using common::equal;
+    using common::less_than;
+    using common::select;
+    using common::splat;
+
+    const V zero = splat<V>(0);
+    const V transparent = splat<V>(colour_transparent);
+    const V window = common::load<V>(window_mask.data() + x);
+
+    // ids 0-3 are the backgrounds, 4 is the object layer and 5 is the backdrop
+    V top = splat<V>(common::read<u16>(palette_ram));
+    V top_priority = splat<V>(4);
+    V top_id = splat<V>(5);
+    V bottom = top;
+    V bottom_priority = top_priority;
+    V bottom_id = top_id;
+
+    // when priorities are equal the lower numbered background wins
     for (int i = 3; i >= 0; i--) {
-        u16 bg_pixel = bg_layers[i][x];
-        if (((enabled >> i) & 0x1) && bg_pixel != colour_transparent) {
-            if (bgcnt[i].priority <= priorities[0]) {
-                targets[1] = targets[0];
-                priorities[1] = priorities[0];
-                targets[0] = i;
-                priorities[0] = bgcnt[i].priority;
-            } else if (bgcnt[i].priority <= priorities[1]) {
-                targets[1] = i;
-                priorities[1] = bgcnt[i].priority;
-            }
+        if (!((dispcnt.data >> (8 + i)) & 0x1)) {
+            continue;
         }
-    }
 
-    // check if an object pixel can replace one of the background pixels
-    // TODO: handle object window later
-    if (dispcnt.enable_obj && obj_buffer[x].colour != colour_transparent) {
-        if (obj_buffer[x].priority <= priorities[0]) {
-            targets[1] = targets[0];
-            targets[0] = 4;
-            is_semi_transparent = obj_buffer[x].semi_transparent;
-        } else if (obj_buffer[x].priority <= priorities[1]) {
-            targets[1] = 4;
-        }
+        const V pixel = common::load<V>(bg_layers[i].data() + x);
+        const V priority = splat<V>(bgcnt[i].priority);
+        const V visible = ~equal(window & (1u << i), zero) & ~equal(pixel, transparent);
+        const V above_top = visible & ~less_than(top_priority, priority);
+        const V above_bottom = visible & ~above_top & ~less_than(bottom_priority, priority);
+
+        bottom = select(above_top, top, select(above_bottom, pixel, bottom));
+        bottom_priority = select(above_top, top_priority, select(above_bottom, priority, bottom_priority));
+        bottom_id = select(above_top, top_id, select(above_bottom, splat<V>(i), bottom_id));
+        top = select(above_top, pixel, top);
+        top_priority = select(above_top, priority, top_priority);
+        top_id = select(above_top, splat<V>(i), top_id);
     }
 
-    // map target indices to pixels
-    std::array<u32, 2> pixels;
-    for (int i = 0; i < 2; i++) {
-        switch (targets[i]) {
-        case 0:
-        case 1:
-        case 2:
-        case 3:
-            pixels[i] = bg_layers[targets[i]][x];
-            break;
-        case 4:
-            pixels[i] = obj_buffer[x].colour;
-            break;
-        case 5:
-            pixels[i] = backdrop;
-            break;
-        }
-    }
+    // objects are drawn above backgrounds with the same priority
+    const V obj_pixel = common::load<V>(obj_colour.data() + x);
+    const V obj_pixel_priority = common::load<V>(obj_priority.data() + x);
+    const V obj_visible = ~equal(window & 0x10u, zero) & ~equal(obj_pixel, transparent);
+    const V obj_above_top = obj_visible & ~less_than(top_priority, obj_pixel_priority);
+    const V obj_above_bottom = obj_visible & ~obj_above_top & ~less_than(bottom_priority, obj_pixel_priority);
+
+    bottom = select(obj_above_top, top, select(obj_above_bottom, obj_pixel, bottom));
+    bottom_id = select(obj_above_top, top_id, select(obj_above_bottom, splat<V>(4), bottom_id));
+    top = select(obj_above_top, obj_pixel, top);
+    top_id = select(obj_above_top, splat<V>(4), top_id);
 
     // blending operations use 18-bit colours, so convert to that first
-    pixels[0] = rgb555_to_rgb666(pixels[0]);
-    pixels[1] = rgb555_to_rgb666(pixels[1]);
+    using common::rgb555_to_rgb666;
 
-    bool top_selected = ((bldcnt.first_target >> targets[0]) & 0x1) || is_semi_transparent;
-    bool bottom_selected = (bldcnt.second_target >> targets[1]) & 0x1;
+    V result = rgb555_to_rgb666(top);
 
-    if (is_semi_transparent && bottom_selected) {
-        plot(x, line, blend(pixels[0], pixels[1], SpecialEffect::AlphaBlending));
-        return;
-    }
+    if (blending) {
+        const V second = rgb555_to_rgb666(bottom);
+        const V effects = ~equal(window & 0x20u, zero);
+        const V semi_transparent = obj_above_top & ~equal(common::load<V>(obj_semi_transparent.data() + x), zero);
+        const V top_selected = ~equal((splat<V>(bldcnt.first_target) >> top_id) & 1u, zero) | semi_transparent;
+        const V bottom_selected = ~equal((splat<V>(bldcnt.second_target) >> bottom_id) & 1u, zero);
 
-    if (!top_selected || (bldcnt.special_effect == SpecialEffect::AlphaBlending && !bottom_selected)) {
         // skip blending if the targets aren't selected
-        plot(x, line, pixels[0]);
-        return;
+        V apply_effect = effects & top_selected;
+        if (bldcnt.special_effect == SpecialEffect::AlphaBlending) {
+            apply_effect &= bottom_selected;
+        }
+
+        if (bldcnt.special_effect != SpecialEffect::None && common::any(apply_effect)) {
+            result = select(apply_effect, blend(result, second, bldcnt.special_effect), result);
+        }
+
+        // semi-transparent objects always get alpha blended with the layer below them
+        const V force_alpha = effects & semi_transparent & bottom_selected;
+        if (common::any(force_alpha)) {
+            result = select(force_alpha, blend(rgb555_to_rgb666(top), second, SpecialEffect::AlphaBlending), result);
+        }
     }
 
-    plot(x, line, blend(pixels[0], pixels[1], bldcnt.special_effect));
+    common::store(framebuffer.data() + (256 * line) + x, result);
 }
 
-u32 PPU::blend(u32 top, u32 bottom, SpecialEffect special_effect) {
-    int r1 = top & 0x3f;
-    int g1 = (top >> 6) & 0x3f;
-    int b1 = (top >> 12) & 0x3f;
+template <typename V>
+V PPU::blend(V top, V bottom, SpecialEffect special_effect) {
+    auto channel = [](V colour, int shift) -> V {
+        return (colour >> shift) & 0x3fu;
+    };
+
+    auto combine = [&](auto function) -> V {
+        V r = function(channel(top, 0), channel(bottom, 0));
+        V g = function(channel(top, 6), channel(bottom, 6));
+        V b = function(channel(top, 12), channel(bottom, 12));
+        return (b << 12) | (g << 6) | r;
+    };
 
     switch (special_effect) {
-    case SpecialEffect::None:
-        return top;
     case SpecialEffect::AlphaBlending: {
-        int eva = std::min<int>(16, bldalpha.eva);
-        int evb = std::min<int>(16, bldalpha.evb);
-        int r2 = bottom & 0x3f;
-        int g2 = (bottom >> 6) & 0x3f;
-        int b2 = (bottom >> 12) & 0x3f;
-
-        int r = std::min<u8>(63, (r1 * eva + r2 * evb + 8) / 16);
-        int b = std::min<u8>(63, (b1 * eva + b2 * evb + 8) / 16);
-        int g = std::min<u8>(63, (g1 * eva + g2 * evb + 8) / 16);
-        return (b << 12) | (g << 6) | r;
+        const u32 eva = std::min<u32>(16, bldalpha.eva);
+        const u32 evb = std::min<u32>(16, bldalpha.evb);
+        return combine([&](V c1, V c2) {
+            return common::min<V>((c1 * eva + c2 * evb + 8) >> 4, common::splat<V>(63));
+        });
     }
     case SpecialEffect::BrightnessIncrease: {
-        int evy = std::min<int>(16, bldy.evy);
-        int r = r1 + ((63 - r1) * evy + 8) / 16;
-        int g = g1 + ((63 - g1) * evy + 8) / 16;
-        int b = b1 + ((63 - b1) * evy + 8) / 16;
-        return (b << 12) | (g << 6) | r;
+        const u32 evy = std::min<u32>(16, bldy.evy);
+        return combine([&](V c1, V) {
+            return c1 + (((63 - c1) * evy + 8) >> 4);
+        });
     }
     case SpecialEffect::BrightnessDecrease: {
-        int evy = std::min<int>(16, bldy.evy);
-        int r = r1 - (r1 * evy + 7) / 16;
-        int g = g1 - (g1 * evy + 7) / 16;
-        int b = b1 - (b1 * evy + 7) / 16;
-        return (b << 12) | (g << 6) | r;
+        const u32 evy = std::min<u32>(16, bldy.evy);
+        return combine([&](V c1, V) {
+            return c1 - ((c1 * evy + 7) >> 4);
+        });
     }
+    default:
+        return top;
     }
 }
 
-} // namespace nds
\ No newline at end of file
+} // namespace nds
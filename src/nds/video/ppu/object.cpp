@@ -1,3 +1,4 @@
+#include <algorithm>
 #include "common/logger.h"
 #include "common/memory.h"
 #include "common/bits.h"
@@ -6,30 +7,54 @@
 namespace nds {
 
 void PPU::render_objects(int line) {
+    // the dispcnt bits which control how sprite tiles are mapped in memory
+    constexpr u32 mapping_mask = 0x700070;
+
+    if (sprites_dirty || sprite_oam_generation != oam_generation || sprite_dispcnt != (dispcnt.data & mapping_mask)) {
+        sprite_oam_generation = oam_generation;
+        sprite_dispcnt = dispcnt.data & mapping_mask;
+        sprites_dirty = false;
+        build_sprite_lists();
+    }
+
+    for (int i = 0; i < num_line_sprites[line]; i++) {
+        const auto& sprite = sprites[line_sprites[line][i]];
+        if (sprite.affine) {
+            render_affine_sprite(sprite, line);
+        } else {
+            render_sprite_row(sprite, line);
+        }
+    }
+}
+
+void PPU::build_sprite_lists() {
+    num_line_sprites.fill(0);
+
     for (int i = 0; i < 128; i++) {
         if ((oam[(i * 8) + 1] & 0x3) == 0x2) {
             continue;
         }
 
         std::array<u16, 3> attributes;
-        std::array<s16, 4> affine_parameters;
         attributes[0] = common::read<u16>(oam, i * 8);
         attributes[1] = common::read<u16>(oam, (i * 8) + 2);
         attributes[2] = common::read<u16>(oam, (i * 8) + 4);
 
+        auto& sprite = sprites[i];
         int y = common::get_field<0, 8>(attributes[0]);
-        bool affine = common::get_bit<8>(attributes[0]);
-        ObjectMode mode = static_cast<ObjectMode>(common::get_field<10, 2>(attributes[0]));
         bool mosaic = common::get_bit<12>(attributes[0]);
-        bool is_8bpp = common::get_bit<13>(attributes[0]);
         u8 shape = common::get_field<14, 2>(attributes[0]);
         int x = common::get_field<0, 9>(attributes[1]);
-        bool horizontal_flip = !affine & common::get_bit<12>(attributes[1]);
-        bool vertical_flip = !affine & common::get_bit<13>(attributes[1]);
         u8 size = common::get_field<14, 2>(attributes[1]);
         u16 tile_number = common::get_field<0, 10>(attributes[2]);
-        u16 priority = common::get_field<10, 2>(attributes[2]);
-        u16 palette_number = common::get_field<12, 4>(attributes[2]);
+
+        sprite.affine = common::get_bit<8>(attributes[0]);
+        sprite.mode = static_cast<ObjectMode>(common::get_field<10, 2>(attributes[0]));
+        sprite.is_8bpp = common::get_bit<13>(attributes[0]);
+        sprite.horizontal_flip = !sprite.affine & common::get_bit<12>(attributes[1]);
+        sprite.vertical_flip = !sprite.affine & common::get_bit<13>(attributes[1]);
+        sprite.priority = common::get_field<10, 2>(attributes[2]);
+        sprite.palette_number = common::get_field<12, 4>(attributes[2]);
 
         if (x >= 256) {
             x -= 512;
@@ -39,127 +64,127 @@ void PPU::render_objects(int line) {
             y -= 256;
         }
 
-        int width = obj_dimensions[shape][size][0];
-        int height = obj_dimensions[shape][size][1];
-        int half_width = width / 2;
-        int half_height = height / 2;
-
-        x += half_width;
-        y += half_height;
+        sprite.width = obj_dimensions[shape][size][0];
+        sprite.height = obj_dimensions[shape][size][1];
+        sprite.half_width = sprite.width / 2;
+        sprite.half_height = sprite.height / 2;
+        sprite.x = x + sprite.half_width;
+        sprite.y = y + sprite.half_height;
 
         if (mosaic) {
             LOG_WARN("handle object mosaic");
         }
 
-        if (affine) {
+        if (sprite.affine) {
             bool double_size = common::get_bit<9>(attributes[0]);
             u16 group = common::get_field<9, 5>(attributes[1]) * 32;
-            
-            affine_parameters[0] = common::read<u16>(oam, group + 0x6);
-            affine_parameters[1] = common::read<u16>(oam, group + 0xe);
-            affine_parameters[2] = common::read<u16>(oam, group + 0x16);
-            affine_parameters[3] = common::read<u16>(oam, group + 0x1e);
+
+            sprite.affine_parameters[0] = common::read<u16>(oam, group + 0x6);
+            sprite.affine_parameters[1] = common::read<u16>(oam, group + 0xe);
+            sprite.affine_parameters[2] = common::read<u16>(oam, group + 0x16);
+            sprite.affine_parameters[3] = common::read<u16>(oam, group + 0x1e);
 
             if (double_size) {
-                x += half_width;
-                y += half_height;
-                half_width *= 2;
-                half_height *= 2;
+                sprite.x += sprite.half_width;
+                sprite.y += sprite.half_height;
+                sprite.half_width *= 2;
+                sprite.half_height *= 2;
             }
-        } else {
-            // for non-affine sprites, we can still use the general affine formula,
-            // but instead use the parameters 0x100, 0, 0 and 0x100
-            // these parameters get treated as identity values, meaning they don't
-            // have any effect in the multiplication
-            affine_parameters[0] = 0x100;
-            affine_parameters[1] = 0;
-            affine_parameters[2] = 0;
-            affine_parameters[3] = 0x100;
         }
 
-        if (mode == ObjectMode::ObjectWindow) {
-            // TODO: handle object window
-            LOG_WARN("handle object window mode");
+        if (sprite.mode == ObjectMode::Bitmap) {
+            if (!dispcnt.bitmap_obj_mapping) {
+                LOG_ERROR("handle 2d mapping bitmap");
+                continue;
+            }
+
+            sprite.tile_base = tile_number * (64 << dispcnt.bitmap_obj_1d_boundary) * 2;
+            sprite.tile_stride = sprite.width * 2;
+        } else if (dispcnt.tile_obj_mapping) {
+            sprite.tile_base = tile_number * (32 << dispcnt.tile_obj_1d_boundary);
+            sprite.tile_stride = sprite.width * (sprite.is_8bpp ? 8 : 4);
+        } else {
+            // in 2d mapping the tiles are laid out in a 32x32 grid, where 8bpp tiles take up 2 entries
+            sprite.tile_base = (sprite.is_8bpp ? (tile_number & ~0x1) : tile_number) * 32;
+            sprite.tile_stride = 32 * 32;
         }
 
-        int local_y = line - y;
-        if (local_y < -half_height || local_y >= half_height) {
-            continue;
+        int first_line = std::max(sprite.y - sprite.half_height, 0);
+        int last_line = std::min(sprite.y + sprite.half_height, 192);
+        for (int line = first_line; line < last_line; line++) {
+            line_sprites[line][num_line_sprites[line]++] = i;
         }
+    }
+}
 
-        for (int local_x = -half_width; local_x <= half_width; local_x++) {
-            u16 colour = 0;
-            int global_x = x + local_x;
-            if (global_x < 0 || global_x >= 256) {
-                continue;
-            }
+void PPU::render_sprite_row(const Sprite& sprite, int line) {
+    int left = sprite.x - sprite.half_width;
+    int y = line - (sprite.y - sprite.half_height);
 
-            int transformed_x = (((affine_parameters[0] * local_x) + (affine_parameters[1] * local_y)) >> 8) + (width / 2);
-            int transformed_y = (((affine_parameters[2] * local_x) + (affine_parameters[3] * local_y)) >> 8) + (height / 2);
+    if (sprite.vertical_flip) {
+        y = sprite.height - y - 1;
+    }
 
-            // make sure the transformed coordinates are still in bounds
-            if (transformed_x < 0 || transformed_y < 0 || transformed_x >= width || transformed_y >= height) {
-                continue;
+    // produce a whole tile row at a time, then place it on the line buffer
+    // the right edge of the sprite is visited from right to left when flipped
+    for (int tile_x = 0; tile_x < sprite.width / 8; tile_x++) {
+        TileRow pixels = decode_obj_tile_row(sprite, tile_x, y);
+        for (int i = 0; i < 8; i++) {
+            int column = (tile_x * 8) + i;
+            if (sprite.horizontal_flip) {
+                column = sprite.width - column - 1;
             }
 
-            if (horizontal_flip) {
-                transformed_x = width - transformed_x - 1;
+            int x = left + column;
+            if (x >= 0 && x < 256) {
+                plot_obj_pixel(sprite, x, pixels[i]);
             }
+        }
+    }
+}
 
-            if (vertical_flip) {
-                transformed_y = height - transformed_y - 1;
-            }
+void PPU::render_affine_sprite(const Sprite& sprite, int line) {
+    int local_y = line - sprite.y;
+    const auto& parameters = sprite.affine_parameters;
 
-            int inner_tile_x = transformed_x % 8;
-            int inner_tile_y = transformed_y % 8;
-            int tile_x = transformed_x / 8;
-            int tile_y = transformed_y / 8;
-            int tile_addr = 0;
-
-            if (mode == ObjectMode::Bitmap) {
-                if (dispcnt.bitmap_obj_mapping) {
-                    colour = obj.read<u16>(((tile_number * (64 << dispcnt.bitmap_obj_1d_boundary)) + (transformed_y * width) + transformed_x) * 2);
-                } else {
-                    LOG_ERROR("handle 2d mapping bitmap");
-                }
-
-                if (!(colour & colour_transparent)) {
-                    colour = colour_transparent;
-                }
-            } else if (is_8bpp) {
-                if (dispcnt.tile_obj_mapping) {
-                    tile_addr = (tile_number * (32 << dispcnt.tile_obj_1d_boundary)) + (tile_y * width * 8);
-                } else {
-                    tile_addr = (tile_number & ~0x1 + tile_y * 32) * 32;
-                }
-
-                tile_addr += tile_x * 64;
-                colour = decode_obj_pixel_8bpp(tile_addr, palette_number, inner_tile_x, inner_tile_y);
-            } else {
-                if (dispcnt.tile_obj_mapping) {
-                    tile_addr = (tile_number * (32 << dispcnt.tile_obj_1d_boundary)) + (tile_y * width * 4);
-                } else {
-                    tile_addr = (tile_number + tile_y * 32) * 32;
-                }
-
-                tile_addr += tile_x * 32;
-                colour = decode_obj_pixel_4bpp(tile_addr, palette_number, inner_tile_x, inner_tile_y);
-            }
+    for (int local_x = -sprite.half_width; local_x < sprite.half_width; local_x++) {
+        int x = sprite.x + local_x;
+        if (x < 0 || x >= 256) {
+            continue;
+        }
 
-            Object& target_obj = obj_buffer[global_x];
-            if (colour != colour_transparent) {
-                if (priority < target_obj.priority) {
-                    target_obj.colour = colour;
-                    target_obj.priority = priority;
-                    target_obj.semi_transparent = mode == ObjectMode::SemiTransparent;
-
-                    if (target_obj.semi_transparent) {
-                        line_has_semi_transparent_obj = true;
-                    }
-                }
-            }
+        int transformed_x = (((parameters[0] * local_x) + (parameters[1] * local_y)) >> 8) + (sprite.width / 2);
+        int transformed_y = (((parameters[2] * local_x) + (parameters[3] * local_y)) >> 8) + (sprite.height / 2);
+
+        // make sure the transformed coordinates are still in bounds
+        if (transformed_x < 0 || transformed_y < 0 || transformed_x >= sprite.width || transformed_y >= sprite.height) {
+            continue;
+        }
+
+        plot_obj_pixel(sprite, x, decode_obj_pixel(sprite, transformed_x, transformed_y));
+    }
+}
+
+void PPU::plot_obj_pixel(const Sprite& sprite, int x, u16 colour) {
+    if (colour == colour_transparent) {
+        return;
+    }
+
+    // object window sprites aren't drawn, they only mark where the object window is
+    if (sprite.mode == ObjectMode::ObjectWindow) {
+        obj_window[x] = 1;
+        return;
+    }
+
+    if (sprite.priority < obj_priority[x]) {
+        obj_colour[x] = colour;
+        obj_priority[x] = sprite.priority;
+        obj_semi_transparent[x] = sprite.mode == ObjectMode::SemiTransparent;
+
+        if (sprite.mode == ObjectMode::SemiTransparent) {
+            line_has_semi_transparent_obj = true;
         }
     }
 }
 
-} // namespace nds
\ No newline at end of file
+} // namespace nds
@@ -1,14 +1,18 @@
 #include <algorithm>
 #include "common/logger.h"
 #include "common/bits.h"
+#include "common/simd.h"
+#include "common/colour.h"
 #include "nds/video/ppu/ppu.h"
 
 namespace nds {
 
-PPU::PPU(GPU& gpu, u8* palette_ram, u8* oam, VRAMRegion& bg, VRAMRegion& obj, VRAMRegion& bg_extended_palette, VRAMRegion& obj_extended_palette, VRAMRegion& lcdc) : 
+PPU::PPU(GPU& gpu, u8* palette_ram, u8* oam, const u32& palette_generation, const u32& oam_generation, VRAMRegion& bg, VRAMRegion& obj, VRAMRegion& bg_extended_palette, VRAMRegion& obj_extended_palette, VRAMRegion& lcdc) : 
     gpu(gpu),
     palette_ram(palette_ram),
     oam(oam),
+    palette_generation(palette_generation),
+    oam_generation(oam_generation),
     bg(bg),
     obj(obj),
     bg_extended_palette(bg_extended_palette),
@@ -40,21 +44,25 @@ void PPU::reset() {
     line_has_semi_transparent_obj = false;
     
     mosaic_bg_vertical_counter = 0;
+    sprites_dirty = true;
+    bg_palettes_dirty = true;
+    bg_extended_palette_valid.fill(false);
 
     framebuffer.fill(0);
-    converted_framebuffer.fill(0);
+    display_fifo.fill(0);
+
+    for (auto& cache : text_line_cache) {
+        for (auto& entry : cache) {
+            entry.valid = false;
+        }
+    }
 }
 
 void PPU::render_scanline(int line) {
     begin_scanline();
 
     if (line == 0) {
-        internal_x[0] = bgx[0];
-        internal_y[0] = bgy[0];
-        internal_x[1] = bgx[1];
-        internal_y[1] = bgy[1];
-
-        mosaic_bg_vertical_counter = 0;
+        reload_internal_registers();
     }
 
     switch (dispcnt.display_mode) {
@@ -68,12 +76,25 @@ void PPU::render_scanline(int line) {
         render_vram_display(line);
         break;
     case 3:
-        LOG_ERROR("PPU: handle main memory display");
+        render_main_memory_display(line);
         break;
     }
 
     apply_master_brightness(line);
+    end_scanline();
+}
+
+void PPU::skip_scanline(int line) {
+    // no pixels are produced, but the internal state still needs to advance
+    // so that the next rendered frame is correct
+    if (line == 0) {
+        reload_internal_registers();
+    }
 
+    end_scanline();
+}
+
+void PPU::end_scanline() {
     // update mosaic vertical counter
     if (mosaic_bg_vertical_counter == mosaic.bg_height) {
         mosaic_bg_vertical_counter = 0;
@@ -179,16 +200,8 @@ void PPU::write_master_bright(u32 value, u32 mask) {
     master_bright.data = (master_bright.data & ~mask) | (value & mask);
 }
 
-u32* PPU::fetch_framebuffer() {
-    std::lock_guard<std::mutex> converted_framebuffer_lock{converted_framebuffer_mutex};
-    return converted_framebuffer.data();
-}
-
-void PPU::on_finish_frame() {
-    std::lock_guard<std::mutex> converted_framebuffer_lock{converted_framebuffer_mutex};
-    for (int i = 0; i < 256 * 192; i++) {
-        converted_framebuffer[i] = rgb666_to_rgb888(framebuffer[i]);
-    }
+void PPU::output_framebuffer(u32* output) {
+    common::convert_rgb666_to_rgb8888(output, framebuffer.data(), 256 * 192);
 }
 
 void PPU::render_blank_screen(int line) {
@@ -200,9 +213,9 @@ void PPU::render_blank_screen(int line) {
 void PPU::render_graphics_display(int line) {
     if (dispcnt.enable_bg0) {
         if (dispcnt.bg0_3d || dispcnt.bg_mode == 6) {
-            const auto* framebuffer = gpu.fetch_framebuffer();
+            const auto* scanline = gpu.fetch_scanline(line);
             for (int i = 0; i < 256; i++) {
-                bg_layers[0][i] = framebuffer[(256 * line) + i];
+                bg_layers[0][i] = scanline[i];
             }
         } else {
             render_text(0, line);
@@ -260,65 +273,61 @@ void PPU::render_graphics_display(int line) {
 }
 
 void PPU::render_vram_display(int line) {
-    for (int x = 0; x < 256; x++) {
-        u32 addr = (dispcnt.vram_block * 0x20000) + ((256 * line) + x) * 2;
-        u16 data = lcdc.read<u16>(addr);
-        plot(x, line, rgb555_to_rgb666(data));
-    }
-}
-
-u32 PPU::rgb555_to_rgb888(u32 colour) {
-    u8 r = ((colour & 0x1f) * 255) / 31;
-    u8 g = (((colour >> 5) & 0x1f) * 255) / 31;
-    u8 b = (((colour >> 10) & 0x1f) * 255) / 31;
-    return (b << 16) | (g << 8) | r;
+    // a row of the bitmap never crosses a vram page
+    alignas(32) std::array<u16, 256> row;
+    lcdc.read_block((dispcnt.vram_block * 0x20000) + (256 * line * 2), row.data(), 256);
+    render_rgb555_line(line, row.data());
 }
 
-u32 PPU::rgb555_to_rgb666(u32 colour) {
-    u8 r = (colour & 0x1f) * 2;
-    u8 g = ((colour >> 5) & 0x1f) * 2;
-    u8 b = ((colour >> 10) & 0x1f) * 2;
-    return (b << 12) | (g << 6) | r;
+void PPU::render_main_memory_display(int line) {
+    render_rgb555_line(line, display_fifo.data());
 }
 
-u32 PPU::rgb666_to_rgb888(u32 colour) {
-    u8 r = ((colour & 0x3f) * 255) / 63;
-    u8 g = (((colour >> 6) & 0x3f) * 255) / 63;
-    u8 b = (((colour >> 12) & 0x3f) * 255) / 63;
-    return 0xff000000 | (b << 16) | (g << 8) | r;
+void PPU::render_rgb555_line(int line, const u16* pixels) {
+    common::convert_rgb555_to_rgb666(framebuffer.data() + (256 * line), pixels, 256);
 }
 
 void PPU::plot(int x, int y, u32 colour) {
     framebuffer[(256 * y) + x] = colour;
 }
 
-u8 PPU::calculate_enabled_layers(int x, int line) {
-    u8 enabled = common::get_field<8, 5>(dispcnt.data);
-    u8 window = common::get_field<13, 3>(dispcnt.data);
-
-    if (window) {
-        u8 win0_x1 = winh[0] >> 8;
-        u8 win0_x2 = winh[0] & 0xff;
-        u8 win0_y1 = winv[0] >> 8;
-        u8 win0_y2 = winv[0] & 0xff;
-        u8 win1_x1 = winh[1] >> 8;
-        u8 win1_x2 = winh[1] & 0xff;
-        u8 win1_y1 = winv[1] >> 8;
-        u8 win1_y2 = winv[1] & 0xff;
-
-        if (dispcnt.enable_win0 && in_window_bounds(x, win0_x1, win0_x2) && in_window_bounds(line, win0_y1, win0_y2)) {
-            enabled &= winin & 0xf;
-        } else if (dispcnt.enable_win1 && in_window_bounds(x, win1_x1, win1_x2) && in_window_bounds(line, win1_y1, win1_y2)) {
-            enabled &= (winin >> 8) & 0xf;
-        } else if (dispcnt.enable_objwin) {
-            // TODO: handle object window
-            LOG_WARN("PPU: handle object window");
-        } else {
-            enabled &= winout & 0xf;  
+void PPU::calculate_window_mask(int line) {
+    u8 enabled = common::get_field<8, 5>(dispcnt.data) | 0x20;
+    if (!dispcnt.enable_win0 && !dispcnt.enable_win1 && !dispcnt.enable_objwin) {
+        window_mask.fill(enabled);
+        return;
+    }
+
+    // start with the area outside of every window, then layer the windows on top
+    // from lowest to highest priority
+    window_mask.fill(winout & enabled);
+
+    if (dispcnt.enable_objwin && dispcnt.enable_obj) {
+        u8 objwin = (winout >> 8) & enabled;
+        for (int x = 0; x < 256; x++) {
+            if (obj_window[x]) {
+                window_mask[x] = objwin;
+            }
         }
     }
 
-    return enabled;
+    for (int i = 1; i >= 0; i--) {
+        bool enable = i == 0 ? dispcnt.enable_win0 : dispcnt.enable_win1;
+        if (!enable || !in_window_bounds(line, winv[i] >> 8, winv[i] & 0xff)) {
+            continue;
+        }
+
+        int x1 = winh[i] >> 8;
+        int x2 = winh[i] & 0xff;
+        u8 mask = (winin >> (i * 8)) & enabled;
+
+        if (x1 <= x2) {
+            std::fill(window_mask.begin() + x1, window_mask.begin() + x2, mask);
+        } else {
+            std::fill(window_mask.begin(), window_mask.begin() + x2, mask);
+            std::fill(window_mask.begin() + x1, window_mask.end(), mask);
+        }
+    }
 }
 
 bool PPU::in_window_bounds(int coord, int start, int end) {
@@ -334,15 +343,23 @@ void PPU::begin_scanline() {
         bg_layers[i].fill(0);
     }
 
-    for (int i = 0; i < 256; i++) {
-        obj_buffer[i].priority = 4;
-        obj_buffer[i].colour = colour_transparent;
-        obj_buffer[i].semi_transparent = false;
-    }
+    obj_colour.fill(colour_transparent);
+    obj_priority.fill(4);
+    obj_semi_transparent.fill(0);
+    obj_window.fill(0);
 
     line_has_semi_transparent_obj = false;
 }
 
+void PPU::reload_internal_registers() {
+    internal_x[0] = bgx[0];
+    internal_y[0] = bgy[0];
+    internal_x[1] = bgx[1];
+    internal_y[1] = bgy[1];
+
+    mosaic_bg_vertical_counter = 0;
+}
+
 void PPU::apply_master_brightness(int line) {
     auto factor = std::min<u32>(16, master_bright.factor);
     if (factor != 0) {
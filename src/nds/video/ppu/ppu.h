@@ -1,9 +1,7 @@
 #pragma once
 
 #include <array>
-#include <mutex>
 #include "common/types.h"
-#include "common/callback.h"
 #include "nds/video/vram_region.h"
 #include "nds/video/gpu/gpu.h"
 
@@ -11,10 +9,11 @@ namespace nds {
 
 class PPU {
 public:
-    PPU(GPU& gpu, u8* palette_ram, u8* oam, VRAMRegion& bg, VRAMRegion& obj, VRAMRegion& bg_extended_palette, VRAMRegion& obj_extended_palette, VRAMRegion& lcdc);
+    PPU(GPU& gpu, u8* palette_ram, u8* oam, const u32& palette_generation, const u32& oam_generation, VRAMRegion& bg, VRAMRegion& obj, VRAMRegion& bg_extended_palette, VRAMRegion& obj_extended_palette, VRAMRegion& lcdc);
 
     void reset();
     void render_scanline(int line);
+    void skip_scanline(int line);
 
     u32 read_dispcnt() const { return dispcnt.data; }
     u16 read_bgcnt(int id) const { return bgcnt[id].data; }
@@ -45,33 +44,46 @@ public:
     void write_bldy(u16 value, u32 mask);
     void write_master_bright(u32 value, u32 mask);
 
-    u32* fetch_framebuffer();
-    void on_finish_frame();
+    const u32* fetch_scanline(int line) { return framebuffer.data() + (256 * line); }
+    void output_framebuffer(u32* output);
+
+    // the rgb555 line which main memory display reads from, filled by the video unit
+    u16* get_display_fifo() { return display_fifo.data(); }
     
 private:
-    using AffineCallback = common::Callback<void(int pixel, int x, int y), 40>;
-
     void render_blank_screen(int line);
     void render_graphics_display(int line);
     void render_vram_display(int line);
+    void render_main_memory_display(int line);
+    void render_rgb555_line(int line, const u16* pixels);
 
     void render_text(int id, int line);
+    void render_text_line(int id, int y, u32 screen_base, u32 character_base, int screen_width);
+
+    template <typename Fetch>
+    void render_affine_layer(int id, int width, int height, Fetch fetch);
+
+    template <bool wraparound, bool mosaic_enabled, typename Fetch>
+    void affine_loop(int id, int width, int height, Fetch fetch);
 
-    void affine_loop(int id, int width, int height, AffineCallback affine_callback);
     void render_affine(int id);
     void render_extended(int id);
     void render_large(int id);
 
+    struct Sprite;
+
     void render_objects(int line);
+    void build_sprite_lists();
+    void render_sprite_row(const Sprite& sprite, int line);
+    void render_affine_sprite(const Sprite& sprite, int line);
+    void plot_obj_pixel(const Sprite& sprite, int x, u16 colour);
 
-    u32 rgb555_to_rgb888(u32 colour);
-    u32 rgb555_to_rgb666(u32 colour);
-    u32 rgb666_to_rgb888(u32 colour);
     void plot(int x, int y, u32 colour);
 
     void compose_scanline(int line);
-    void compose_pixel(int x, int line);
-    void compose_pixel_with_special_effects(int x, int line);
+
+    template <typename V>
+    void compose_pixels(int x, int line, bool blending);
 
     enum SpecialEffect : u16 {
         None = 0,
@@ -80,19 +92,22 @@ private:
         BrightnessDecrease = 3,
     };
 
-    u32 blend(u32 top, u32 bottom, SpecialEffect special_effect);
+    template <typename V>
+    V blend(V top, V bottom, SpecialEffect special_effect);
 
     using TileRow = std::array<u16, 8>;
 
-    u16 decode_obj_pixel_4bpp(u32 base, int number, int x, int y);
-    u16 decode_obj_pixel_8bpp(u32 base, int number, int x, int y);
-    TileRow decode_tile_row_4bpp(u32 tile_base, int tile_number, int palette_number, int y, bool horizontal_flip, bool vertical_flip);
-    TileRow decode_tile_row_8bpp(u32 tile_base, int tile_number, int palette_number, int y, bool horizontal_flip, bool vertical_flip, int extended_palette_slot);
+    u16 decode_obj_pixel(const Sprite& sprite, int x, int y);
+    TileRow decode_obj_tile_row(const Sprite& sprite, int tile_x, int y);
+    void update_bg_palettes();
+    const u16* get_bg_extended_palette(int slot);
 
-    u8 calculate_enabled_layers(int x, int line);
+    void calculate_window_mask(int line);
     bool in_window_bounds(int coord, int start, int end);
 
     void begin_scanline();
+    void end_scanline();
+    void reload_internal_registers();
     void apply_master_brightness(int line);
 
     union DISPCNT {
@@ -200,12 +215,6 @@ private:
         u16 data;
     };
 
-    struct Object {
-        int priority;
-        u16 colour;
-        bool semi_transparent;
-    };
-
     enum class ObjectMode : int {
         Normal = 0,
         SemiTransparent = 1,
@@ -213,6 +222,34 @@ private:
         Bitmap,
     };
 
+    // the decoded attributes of an oam entry, which only need to be rebuilt
+    // when oam or the object mapping mode changes
+    struct Sprite {
+        // the centre of the sprite on screen
+        int x;
+        int y;
+        int width;
+        int height;
+
+        // the size of the area the sprite covers, which is doubled for double size affine sprites
+        int half_width;
+        int half_height;
+
+        bool affine;
+        std::array<s16, 4> affine_parameters;
+        ObjectMode mode;
+        bool is_8bpp;
+        bool horizontal_flip;
+        bool vertical_flip;
+        u8 priority;
+        u8 palette_number;
+
+        // the address of the first tile and the distance between each row of tiles,
+        // or between each row of pixels for bitmap sprites
+        u32 tile_base;
+        u32 tile_stride;
+    };
+
     DISPCNT dispcnt;
     std::array<BGCNT, 4> bgcnt;
     std::array<u16, 4> bghofs;
@@ -239,14 +276,64 @@ private:
     int mosaic_bg_vertical_counter;
 
     std::array<u32, 256 * 192> framebuffer;
-    std::array<u32, 256 * 192> converted_framebuffer;
-    std::mutex converted_framebuffer_mutex;
     std::array<std::array<u16, 256>, 4> bg_layers;
-    std::array<Object, 256> obj_buffer;
+    alignas(32) std::array<u16, 256> display_fifo;
+
+    // a decoded text background line, which gets reused as long as the registers
+    // and the video memory it depends on haven't changed
+    struct TextLineCache {
+        bool valid;
+        u16 bgcnt;
+        u16 bghofs;
+        int y;
+        u32 screen_base;
+        u32 character_base;
+        bool extended_palette;
+        u32 palette_generation;
+        u64 screen_generation;
+        u64 character_generation;
+        u64 extended_palette_generation;
+        std::array<u16, 256> pixels;
+    };
+
+    std::array<std::array<TextLineCache, 192>, 4> text_line_cache;
+
+    // palette lookup tables for background tiles, where colour 0 of each palette is already transparent
+    // the 4bpp table holds 16 palettes of 16 colours and the extended palette tables hold 16 palettes of 256 colours
+    std::array<u16, 256> bg_palette_4bpp;
+    std::array<u16, 256> bg_palette_8bpp;
+    u32 bg_palette_generation;
+    bool bg_palettes_dirty;
+    std::array<std::array<u16, 16 * 256>, 4> bg_extended_palettes;
+    std::array<u64, 4> bg_extended_palette_generations;
+    std::array<bool, 4> bg_extended_palette_valid;
+
+    // the sprites which cover each scanline in oam order
+    std::array<Sprite, 128> sprites;
+    std::array<std::array<u8, 128>, 192> line_sprites;
+    std::array<u8, 192> num_line_sprites;
+    u32 sprite_oam_generation;
+    u32 sprite_dispcnt;
+    bool sprites_dirty;
+
+    // the object layer of the current scanline, split into separate arrays
+    // so the compositor can load several pixels at a time
+    std::array<u16, 256> obj_colour;
+    std::array<u8, 256> obj_priority;
+    std::array<u8, 256> obj_semi_transparent;
+    std::array<u8, 256> obj_window;
+
+    // the layers which are visible at each pixel of the current scanline after applying the windows
+    // bits 0-3: bg0-3
+    // bit 4: obj
+    // bit 5: colour special effects
+    std::array<u8, 256> window_mask;
     
     GPU& gpu;
     u8* palette_ram;
     u8* oam;
+    const u32& palette_generation;
+    const u32& oam_generation;
     VRAMRegion& bg;
     VRAMRegion& obj;
     VRAMRegion& bg_extended_palette;
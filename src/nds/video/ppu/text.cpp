@@ -1,4 +1,6 @@
+#include <cstring>
 #include "common/logger.h"
+#include "common/tile_decoder.h"
 #include "common/bits.h"
 #include "nds/video/ppu/ppu.h"
 #include "nds/video/video_unit.h"
@@ -6,6 +8,8 @@
 namespace nds {
 
 void PPU::render_text(int id, int line) {
+    auto& cache = text_line_cache[id][line];
+
     // apply vertical mosaic
     if (bgcnt[id].mosaic) {
         line -= mosaic_bg_vertical_counter;
@@ -26,35 +30,40 @@ void PPU::render_text(int id, int line) {
         }
     }
 
-    std::array<u16, 8> pixels;
-    for (int tile = 0; tile <= 256; tile += 8) {
-        int x = (tile + bghofs[id]) % 512;
-        u32 screen_addr = screen_base + ((x / 8) % 32) * 2;
-
-        if (x >= 256 && screen_width == 512) {
-            screen_addr += 2048;
-        }
+    // check if the line can be reused from a previous frame
+    bool extended_palette = bgcnt[id].palette_8bpp && dispcnt.bg_extended_palette;
+    u32 screen_block = (dispcnt.screen_base * 65536) + (bgcnt[id].screen_base * 2048);
+    u64 screen_generation = bg.get_generation(screen_block, 0x2000);
+    u64 character_generation = bg.get_generation(character_base, bgcnt[id].palette_8bpp ? 0x10000 : 0x8000);
+    u64 extended_palette_generation = extended_palette ? bg_extended_palette.get_generation(extended_palette_slot * 0x2000, 0x2000) : 0;
 
-        u16 tile_info = bg.read<u16>(screen_addr);
-        int tile_number = common::get_field<0, 10>(tile_info);
-        bool horizontal_flip = common::get_bit<10>(tile_info);;
-        bool vertical_flip = common::get_bit<11>(tile_info);
-        int palette_number = common::get_field<12, 4>(tile_info);
+    if (cache.valid &&
+        cache.bgcnt == bgcnt[id].data &&
+        cache.bghofs == bghofs[id] &&
+        cache.y == y &&
+        cache.screen_base == screen_base &&
+        cache.character_base == character_base &&
+        cache.extended_palette == extended_palette &&
+        cache.palette_generation == palette_generation &&
+        cache.screen_generation == screen_generation &&
+        cache.character_generation == character_generation &&
+        cache.extended_palette_generation == extended_palette_generation) {
+        bg_layers[id] = cache.pixels;
+    } else {
+        render_text_line(id, y, screen_base, character_base, screen_width);
 
-        if (bgcnt[id].palette_8bpp) {
-            pixels = decode_tile_row_8bpp(character_base, tile_number, palette_number, y, horizontal_flip, vertical_flip, extended_palette_slot);
-        } else {
-            pixels = decode_tile_row_4bpp(character_base, tile_number, palette_number, y, horizontal_flip, vertical_flip);
-        }
-
-        for (int j = 0; j < 8; j++) {
-            int offset = tile + j - (x % 8);
-            if (offset < 0 || offset >= 256) {
-                continue;
-            }
-
-            bg_layers[id][offset] = pixels[j];
-        }
+        cache.valid = true;
+        cache.bgcnt = bgcnt[id].data;
+        cache.bghofs = bghofs[id];
+        cache.y = y;
+        cache.screen_base = screen_base;
+        cache.character_base = character_base;
+        cache.extended_palette = extended_palette;
+        cache.palette_generation = palette_generation;
+        cache.screen_generation = screen_generation;
+        cache.character_generation = character_generation;
+        cache.extended_palette_generation = extended_palette_generation;
+        cache.pixels = bg_layers[id];
     }
 
     // apply horizontal mosaic
@@ -72,4 +81,44 @@ void PPU::render_text(int id, int line) {
     }
 }
 
+void PPU::render_text_line(int id, int y, u32 screen_base, u32 character_base, int screen_width) {
+    update_bg_palettes();
+
+    const u16* palette_8bpp = bg_palette_8bpp.data();
+    bool extended_palette = dispcnt.bg_extended_palette;
+    if (bgcnt[id].palette_8bpp && extended_palette) {
+        palette_8bpp = get_bg_extended_palette(id | (bgcnt[id].wraparound_ext_palette_slot * 2));
+    }
+
+    // decode whole tiles into a tile aligned buffer, then copy out the visible part of the line
+    alignas(32) std::array<u16, 264> pixels;
+    int row = y % 8;
+    for (int tile = 0; tile < 33; tile++) {
+        int x = ((tile * 8) + bghofs[id]) % 512;
+        u32 screen_addr = screen_base + ((x / 8) % 32) * 2;
+
+        if (x >= 256 && screen_width == 512) {
+            screen_addr += 2048;
+        }
+
+        u16 tile_info = bg.read<u16>(screen_addr);
+        int tile_number = common::get_field<0, 10>(tile_info);
+        bool horizontal_flip = common::get_bit<10>(tile_info);
+        bool vertical_flip = common::get_bit<11>(tile_info);
+        int palette_number = common::get_field<12, 4>(tile_info);
+        int tile_row = vertical_flip ? (row ^ 7) : row;
+
+        if (bgcnt[id].palette_8bpp) {
+            u64 indices = bg.read<u64>(character_base + (tile_number * 64) + (tile_row * 8));
+            const u16* palette = extended_palette ? palette_8bpp + (palette_number * 256) : palette_8bpp;
+            common::decode_tile_row_8bpp(pixels.data() + (tile * 8), indices, palette, horizontal_flip);
+        } else {
+            u32 indices = bg.read<u32>(character_base + (tile_number * 32) + (tile_row * 4));
+            common::decode_tile_row_4bpp(pixels.data() + (tile * 8), indices, bg_palette_4bpp.data() + (palette_number * 16), horizontal_flip);
+        }
+    }
+
+    std::memcpy(bg_layers[id].data(), pixels.data() + (bghofs[id] % 8), sizeof(bg_layers[id]));
+}
+
 } // namespace nds
\ No newline at end of file
@@ -1,70 +1,112 @@
 #include "common/memory.h"
 #include "common/logger.h"
+#include "common/tile_decoder.h"
 #include "nds/video/ppu/ppu.h"
 #include "nds/video/video_unit.h"
 
 namespace nds {
 
-u16 PPU::decode_obj_pixel_4bpp(u32 base, int number, int x, int y) {
-    auto indices = obj.read<u8>(base + (y * 4) + (x / 2));
-    auto index = (indices >> (4 * (x & 0x1))) & 0xf;
-    if (index == 0) {
-        return colour_transparent;
-    } else {
-        return common::read<u16>(palette_ram, (0x200 + (number * 32) + (index * 2)) & 0x3ff);
+u16 PPU::decode_obj_pixel(const Sprite& sprite, int x, int y) {
+    if (sprite.mode == ObjectMode::Bitmap) {
+        u16 colour = obj.read<u16>(sprite.tile_base + (y * sprite.tile_stride) + (x * 2));
+        return (colour & 0x8000) ? colour : colour_transparent;
     }
-}
 
-u16 PPU::decode_obj_pixel_8bpp(u32 base, int number, int x, int y) {
-    auto index = obj.read<u8>(base + (y * 8) + x);
+    u32 tile_addr = sprite.tile_base + ((y / 8) * sprite.tile_stride) + ((x / 8) * (sprite.is_8bpp ? 64 : 32));
+    int inner_x = x % 8;
+    int inner_y = y % 8;
+
+    if (sprite.is_8bpp) {
+        u8 index = obj.read<u8>(tile_addr + (inner_y * 8) + inner_x);
+        if (index == 0) {
+            return colour_transparent;
+        } else if (dispcnt.obj_extended_palette) {
+            return obj_extended_palette.read<u16>(((sprite.palette_number * 256) + index) * 2);
+        } else {
+            return common::read<u16>(palette_ram, (0x200 + (index * 2)) & 0x3ff);
+        }
+    }
+
+    u8 indices = obj.read<u8>(tile_addr + (inner_y * 4) + (inner_x / 2));
+    u8 index = (indices >> (4 * (inner_x & 0x1))) & 0xf;
     if (index == 0) {
         return colour_transparent;
-    } else if (dispcnt.obj_extended_palette) {
-        return obj_extended_palette.read<u16>((number * 0xff + index) * 2);
     } else {
-        return common::read<u16>(palette_ram, (0x200 + (index * 2)) & 0x3ff);
+        return common::read<u16>(palette_ram, (0x200 + (sprite.palette_number * 32) + (index * 2)) & 0x3ff);
     }
 }
 
-PPU::TileRow PPU::decode_tile_row_4bpp(u32 tile_base, int tile_number, int palette_number, int y, bool horizontal_flip, bool vertical_flip) {
+// decodes 8 pixels of row y of a sprite, starting at the tile tile_x, before any horizontal flip is applied
+PPU::TileRow PPU::decode_obj_tile_row(const Sprite& sprite, int tile_x, int y) {
     TileRow pixels;
-    int row = (vertical_flip ? (y ^ 7) : y) % 8;
-    u32 tile_addr = tile_base + (tile_number * 32) + (row * 4);
-    u32 palette_indices = bg.read<u32>(tile_addr);
+
+    if (sprite.mode == ObjectMode::Bitmap) {
+        u32 addr = sprite.tile_base + (y * sprite.tile_stride) + (tile_x * 16);
+        for (int x = 0; x < 8; x++) {
+            u16 colour = obj.read<u16>(addr + (x * 2));
+            pixels[x] = (colour & 0x8000) ? colour : colour_transparent;
+        }
+
+        return pixels;
+    }
+
+    int inner_y = y % 8;
+
+    if (sprite.is_8bpp) {
+        u32 addr = sprite.tile_base + ((y / 8) * sprite.tile_stride) + (tile_x * 64) + (inner_y * 8);
+        u64 palette_indices = obj.read<u64>(addr);
+
+        for (int x = 0; x < 8; x++) {
+            int palette_index = palette_indices & 0xff;
+            if (palette_index == 0) {
+                pixels[x] = colour_transparent;
+            } else if (dispcnt.obj_extended_palette) {
+                pixels[x] = obj_extended_palette.read<u16>(((sprite.palette_number * 256) + palette_index) * 2);
+            } else {
+                pixels[x] = common::read<u16>(palette_ram, (0x200 + (palette_index * 2)) & 0x3ff);
+            }
+
+            palette_indices >>= 8;
+        }
+
+        return pixels;
+    }
+
+    u32 addr = sprite.tile_base + ((y / 8) * sprite.tile_stride) + (tile_x * 32) + (inner_y * 4);
+    u32 palette_indices = obj.read<u32>(addr);
+    u32 palette_base = 0x200 + (sprite.palette_number * 32);
 
     for (int x = 0; x < 8; x++) {
-        int column = horizontal_flip ? (x ^ 7) : x;
         int palette_index = palette_indices & 0xf;
-        u32 palette_addr = (palette_number * 32) + (palette_index * 2);
-        pixels[column] = (palette_index == 0) ? colour_transparent : common::read<u16>(palette_ram, palette_addr & 0x3ff);
+        pixels[x] = (palette_index == 0) ? colour_transparent : common::read<u16>(palette_ram, (palette_base + (palette_index * 2)) & 0x3ff);
         palette_indices >>= 4;
     }
-    
+
     return pixels;
 }
 
-PPU::TileRow PPU::decode_tile_row_8bpp(u32 tile_base, int tile_number, int palette_number, int y, bool horizontal_flip, bool vertical_flip, int extended_palette_slot) {
-    TileRow pixels;
-    int row = (vertical_flip ? (y ^ 7) : y) % 8;
-    u32 tile_addr = tile_base + (tile_number * 64) + (row * 8);
-    u64 palette_indices = bg.read<u64>(tile_addr);
+void PPU::update_bg_palettes() {
+    if (bg_palettes_dirty || bg_palette_generation != palette_generation) {
+        common::build_palette_lut_4bpp(bg_palette_4bpp.data(), palette_ram, colour_transparent);
+        common::build_palette_lut_8bpp(bg_palette_8bpp.data(), palette_ram, colour_transparent);
+        bg_palette_generation = palette_generation;
+        bg_palettes_dirty = false;
+    }
+}
 
-    for (int x = 0; x < 8; x++) {
-        int column = horizontal_flip ? (x ^ 7) : x;
-        int palette_index = palette_indices & 0xff;
-        
-        if (palette_index == 0) {
-            pixels[column] = colour_transparent;
-        } else if (dispcnt.bg_extended_palette) {
-            pixels[column] = bg_extended_palette.read<u16>(extended_palette_slot * 0x2000 + (palette_number * 256 + palette_index) * 2);
-        } else {
-            pixels[column] = common::read<u16>(palette_ram, (palette_index * 2) & 0x3ff);
+const u16* PPU::get_bg_extended_palette(int slot) {
+    u64 generation = bg_extended_palette.get_generation(slot * 0x2000, 0x2000);
+    if (!bg_extended_palette_valid[slot] || bg_extended_palette_generations[slot] != generation) {
+        auto& lut = bg_extended_palettes[slot];
+        for (int i = 0; i < 16 * 256; i++) {
+            lut[i] = (i & 0xff) == 0 ? colour_transparent : bg_extended_palette.read<u16>((slot * 0x2000) + (i * 2));
         }
 
-        palette_indices >>= 8;
+        bg_extended_palette_generations[slot] = generation;
+        bg_extended_palette_valid[slot] = true;
     }
-    
-    return pixels;
+
+    return bg_extended_palettes[slot].data();
 }
 
 } // namespace nds
\ No newline at end of file
@@ -1,14 +1,18 @@
 #include <algorithm>
+#include <cstring>
 #include "common/logger.h"
+#include "common/bits.h"
+#include "common/simd.h"
+#include "common/colour.h"
 #include "nds/video/video_unit.h"
 #include "nds/system.h"
 
 namespace nds {
 
 VideoUnit::VideoUnit(System& system) :
-    gpu(system.scheduler, system.dma9, system.arm9.get_irq(), vram.texture_data, vram.texture_palette),
-    ppu_a(gpu, get_palette_ram(), get_oam(), vram.bga, vram.obja, vram.bga_extended_palette, vram.obja_extended_palette, vram.lcdc),
-    ppu_b(gpu, get_palette_ram() + 0x400, get_oam() + 0x400, vram.bgb, vram.objb, vram.bgb_extended_palette, vram.objb_extended_palette, vram.lcdc),
+    gpu(system.scheduler, system.dma9, system.arm9.get_irq(), vram.texture_data, vram.texture_palette, system.thread_pool),
+    ppu_a(gpu, get_palette_ram(), get_oam(), palette_generations[0], oam_generations[0], vram.bga, vram.obja, vram.bga_extended_palette, vram.obja_extended_palette, vram.lcdc),
+    ppu_b(gpu, get_palette_ram() + 0x400, get_oam() + 0x400, palette_generations[1], oam_generations[1], vram.bgb, vram.objb, vram.bgb_extended_palette, vram.objb_extended_palette, vram.lcdc),
     system(system),
     irq7(system.arm7.get_irq()),
     irq9(system.arm9.get_irq()) {}
@@ -16,13 +20,20 @@ VideoUnit::VideoUnit(System& system) :
 void VideoUnit::reset() {
     palette_ram.fill(0);
     oam.fill(0);
+    palette_generations.fill(0);
+    oam_generations.fill(0);
     powcnt1.data = 0;
     dispstat7.data = 0;
     dispstat9.data = 0;
     dispcapcnt.data = 0;
     vcount = 0;
     display_capture = false;
+    display_fifo_position = 0;
+    skip_frame = false;
+    skip_next_frame = false;
 
+    // the 3d renderer reads texture vram from its own thread
+    gpu.wait_for_render();
     vram.reset();
     gpu.reset();
     ppu_a.reset();
@@ -71,92 +82,55 @@ void VideoUnit::write_dispcapcnt(u32 value, u32 mask) {
     dispcapcnt.data = (dispcapcnt.data & ~mask) | (value & mask);
 }
 
-u32* VideoUnit::fetch_framebuffer(Screen screen) {
-    if (powcnt1.display_swap == (screen == Screen::Top)) {
-        return ppu_a.fetch_framebuffer();
-    } else {
-        return ppu_b.fetch_framebuffer();
-    }
+void VideoUnit::write_display_fifo(u32 value) {
+    common::write<u32>(reinterpret_cast<u8*>(ppu_a.get_display_fifo()), value, display_fifo_position * 4);
+    display_fifo_position = (display_fifo_position + 1) % 128;
 }
 
 void VideoUnit::render_scanline_start() {
-    if (vcount < 192) {
-        ppu_a.render_scanline(vcount);
-        ppu_b.render_scanline(vcount);
-        system.dma9.trigger(DMA::Timing::HBlank);
+    if (vcount == 0) {
+        // display capture needs the rendered output, so never skip a frame
+        // where a capture will take place
+        skip_frame = skip_next_frame && !dispcapcnt.capture_enable;
+
+        if (skip_next_frame && !skip_frame) {
+            gpu.render();
+        }
     }
 
     if (vcount == 0 && dispcapcnt.capture_enable) {
         display_capture = true;
     }
 
-    if (display_capture) {
-        int width = display_capture_dimensions[dispcapcnt.capture_size][0];
-        int height = display_capture_dimensions[dispcapcnt.capture_size][1];
-        u32 base = 0x06800000 + (dispcapcnt.vram_write_block * 0x20000);
-        u32 write_offset = (dispcapcnt.vram_write_offset * 0x8000) + vcount * width * 2;
-
-        switch (dispcapcnt.capture_source) {
-        case 0: {
-            u32* line;
-
-            // source a
-            if (dispcapcnt.source_a) {
-                // capture 3d
-                line = gpu.fetch_framebuffer() + (vcount * 256);
-            } else {
-                // capture 2d
-                line = ppu_a.fetch_framebuffer() + (vcount * 256);
-            }
-
-            for (int i = 0; i < width; i++) {
-                vram.write<u16>(base + (write_offset & 0x1ffff), rgb666_to_rgb555(line[i]));
-                write_offset += 2;
-            }
-
-            break;
-        }
-        case 1:
-            LOG_TODO("handle source b video capture");
-        default: {
-            if (dispcapcnt.source_b) {
-                LOG_TODO("handle capture from main memory display fifo");
-            }
-
-            u32* line;
-
-            // source a
-            if (dispcapcnt.source_a) {
-                // capture 3d
-                line = gpu.fetch_framebuffer() + (vcount * 256);
-            } else {
-                // capture 2d
-                line = ppu_a.fetch_framebuffer() + (vcount * 256);
-            }
-
-            u32 read_offset = (dispcapcnt.vram_read_offset * 0x8000) + vcount * width * 2;
-            u8 eva = std::min<u8>(dispcapcnt.eva, 16);
-            u8 evb = std::min<u8>(dispcapcnt.evb, 16);
-            
-            for (int i = 0; i < width; i++) {
-                u16 first = rgb666_to_rgb555(line[i]);
-                u16 second = vram.read<u16>(base + (read_offset & 0x1ffff));
-
-                u8 r = std::min(((first & 0x1f) * eva + (second & 0x1f) * evb) / 16, 31);
-                u8 g = std::min((((first >> 5) & 0x1f) * eva + ((second >> 5) & 0x1f) * evb) / 16, 31);
-                u8 b = std::min((((first >> 10) & 0x1f) * eva + ((second >> 10) & 0x1f) * evb) / 16, 31);
-                u16 colour = 0x8000 | (b << 10) | (g << 5) | r;
-                vram.write<u16>(base + (write_offset & 0x1ffff), colour);
-                read_offset += 2;
-                write_offset += 2;
-            }
-
-            break;
+    if (vcount < 192) {
+        // the cpu fills the fifo a scanline at a time, so a stray or missing write
+        // only affects the line it was meant for
+        display_fifo_position = 0;
+
+        // the fifo is used by main memory display and by captures which read from it,
+        // and has to be filled even when the frame is skipped so that the dma stays in sync
+        bool main_memory_display = common::get_field<16, 2>(ppu_a.read_dispcnt()) == 3;
+        bool capture_from_fifo = display_capture && dispcapcnt.capture_source != 0 && dispcapcnt.source_b;
+        if (main_memory_display || capture_from_fifo) {
+            fill_display_fifo();
         }
+
+        if (skip_frame) {
+            ppu_a.skip_scanline(vcount);
+            ppu_b.skip_scanline(vcount);
+        } else {
+            ppu_a.render_scanline(vcount);
+            ppu_b.render_scanline(vcount);
         }
 
+        system.dma9.trigger(DMA::Timing::HBlank);
+    }
+
+    if (display_capture) {
+        capture_scanline(vcount);
+
         // TODO: see if dispcapcnt busy bit gets cleared at height or 192 scanline
-        if (vcount + 1 == height) {
+        if (vcount + 1 == display_capture_dimensions[dispcapcnt.capture_size][1]) {
             dispcapcnt.capture_enable = false;
             display_capture = false;
         }
@@ -174,7 +148,12 @@ void VideoUnit::render_scanline_start() {
     }
 
     if (vcount == 215) {
-        gpu.render();
+        // the 3d framebuffer is only used by the next frame
+        skip_next_frame = system.should_skip_frame();
+
+        if (!skip_next_frame) {
+            gpu.render();
+        }
     }
 
     // TODO: is this correctly implemented?
@@ -206,6 +185,15 @@ void VideoUnit::render_scanline_end() {
 
         system.dma9.trigger(DMA::Timing::VBlank);
         gpu.do_swap_buffers();
+
+        if (!skip_frame) {
+            auto& top = powcnt1.display_swap ? ppu_a : ppu_b;
+            auto& bottom = powcnt1.display_swap ? ppu_b : ppu_a;
+            top.output_framebuffer(system.get_output_framebuffer(static_cast<int>(Screen::Top)));
+            bottom.output_framebuffer(system.get_output_framebuffer(static_cast<int>(Screen::Bottom)));
+            system.present_frame();
+        }
+
         break;
     case 262:
         dispstat7.vblank = false;
@@ -234,11 +222,97 @@ void VideoUnit::render_scanline_end() {
     }
 }
 
-u16 VideoUnit::rgb666_to_rgb555(u32 colour) {
-    u8 r = (colour & 0x3f) / 2;
-    u8 g = ((colour >> 6) & 0x3f) / 2;
-    u8 b = ((colour >> 12) & 0x3f) / 2;
-    return 0x8000 | (b << 10) | (g << 5) | r;
+void VideoUnit::capture_scanline(int line) {
+    int width = display_capture_dimensions[dispcapcnt.capture_size][0];
+    u32 write_addr = 0x06800000 + (dispcapcnt.vram_write_block * 0x20000) + (((dispcapcnt.vram_write_offset * 0x8000) + (line * width * 2)) & 0x1ffff);
+
+    // source a is either the output of engine a or the 3d layer
+    const u32* line_a = dispcapcnt.source_a ? gpu.fetch_scanline(line) : ppu_a.fetch_scanline(line);
+
+    // source b is read from the vram block selected in engine a's dispcnt
+    alignas(32) std::array<u16, 256> line_b;
+    if (dispcapcnt.capture_source != 0) {
+        if (dispcapcnt.source_b) {
+            std::memcpy(line_b.data(), ppu_a.get_display_fifo(), width * 2);
+        } else {
+            u32 vram_block = common::get_field<18, 2>(ppu_a.read_dispcnt());
+            u32 read_addr = 0x06800000 + (vram_block * 0x20000) + (((dispcapcnt.vram_read_offset * 0x8000) + (line * width * 2)) & 0x1ffff);
+            vram.lcdc.read_block(read_addr, line_b.data(), width);
+        }
+    }
+
+    alignas(32) std::array<u16, 256> output;
+    if constexpr (common::simd_accelerated) {
+        for (int x = 0; x < width; x += common::lanes<common::u32x8>()) {
+            capture_pixels<common::u32x8>(x, line_a, line_b.data(), output.data());
+        }
+    } else {
+        for (int x = 0; x < width; x++) {
+            capture_pixels<u32>(x, line_a, line_b.data(), output.data());
+        }
+    }
+
+    // a captured row never crosses a vram page, so it can be written in one go
+    vram.lcdc.write_block(write_addr, output.data(), width);
+}
+
+void VideoUnit::fill_display_fifo() {
+    auto source = system.dma9.advance_main_memory_display(128);
+    if (!source) {
+        // without dma the fifo holds whatever the cpu has written to it
+        return;
+    }
+
+    // the dma always reads from main memory, so the whole scanline can be copied at once,
+    // only needing to be split when it wraps around the end of main memory
+    u8* fifo = reinterpret_cast<u8*>(ppu_a.get_display_fifo());
+    u8* main_memory = system.main_memory->data();
+    u32 offset = *source & 0x3fffff;
+    u32 size = std::min<u32>(512, 0x400000 - offset);
+    std::memcpy(fifo, main_memory + offset, size);
+    std::memcpy(fifo + size, main_memory, 512 - size);
+}
+
+// produces lanes<V>() captured pixels starting at x, in rgb555 with the alpha bit at bit 15
+template <typename V>
+void VideoUnit::capture_pixels(int x, const u32* line_a, const u16* line_b, u16* output) {
+    using common::equal;
+    using common::splat;
+
+    const V zero = splat<V>(0);
+    const V pixel_a = common::load<V>(line_a + x);
+    V a;
+
+    if (dispcapcnt.source_a) {
+        // 3d pixels are already rgb555, apart from transparent ones
+        a = common::select(equal(pixel_a, splat<V>(0x8000)), zero, pixel_a | 0x8000u);
+    } else {
+        // 2d pixels are rgb666 and always opaque
+        a = common::rgb666_to_rgb555(pixel_a) | 0x8000u;
+    }
+
+    if (dispcapcnt.capture_source == 0) {
+        common::store(output + x, a);
+        return;
+    }
+
+    const V b = common::load<V>(line_b + x);
+    if (dispcapcnt.capture_source == 1) {
+        common::store(output + x, b);
+        return;
+    }
+
+    // each source only contributes when its alpha bit is set
+    const V eva = ((a >> 15) & 1u) * std::min<u32>(dispcapcnt.eva, 16);
+    const V evb = ((b >> 15) & 1u) * std::min<u32>(dispcapcnt.evb, 16);
+
+    auto channel = [&](int shift) -> V {
+        const V blended = ((((a >> shift) & 0x1fu) * eva) + (((b >> shift) & 0x1fu) * evb) + 8u) >> 4;
+        return common::min<V>(blended, splat<V>(31)) << shift;
+    };
+
+    const V alpha = ~equal(eva | evb, zero) & 0x8000u;
+    common::store(output + x, channel(0) | channel(5) | channel(10) | alpha);
 }
 
 } // namespace nds
\ No newline at end of file
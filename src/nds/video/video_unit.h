@@ -36,8 +36,7 @@ public:
 
     u32 read_dispcapcnt() { return dispcapcnt.data; }
     void write_dispcapcnt(u32 value, u32 mask);
-
-    u32* fetch_framebuffer(Screen screen);
+    void write_display_fifo(u32 value);
 
     u8* get_palette_ram() { return palette_ram.data(); }
     u8* get_oam() { return oam.data(); }
@@ -55,11 +54,13 @@ public:
     template <typename T>
     void write_palette_ram(u32 addr, T value) {
         common::write<T>(palette_ram.data(), value, addr & 0x7ff);
+        palette_generations[(addr >> 10) & 0x1]++;
     }
 
     template <typename T>
     void write_oam(u32 addr, T value) {
         common::write<T>(oam.data(), value, addr & 0x7ff);
+        oam_generations[(addr >> 10) & 0x1]++;
     }
 
     VRAM vram;
@@ -70,7 +71,11 @@ public:
 private:
     void render_scanline_start();
     void render_scanline_end();
-    u16 rgb666_to_rgb555(u32 colour);
+    void capture_scanline(int line);
+    void fill_display_fifo();
+
+    template <typename V>
+    void capture_pixels(int x, const u32* line_a, const u16* line_b, u16* output);
 
     union POWCNT1 {
         struct {
@@ -127,12 +132,19 @@ private:
     std::array<u8, 0x800> palette_ram;
     std::array<u8, 0x800> oam;
 
+    // write counters for the palette ram and oam of each engine
+    std::array<u32, 2> palette_generations;
+    std::array<u32, 2> oam_generations;
+
     common::EventType scanline_start_event;
     common::EventType scanline_end_event;
 
     POWCNT1 powcnt1;
     u16 vcount;
     bool display_capture{false};
+    int display_fifo_position{0};
+    bool skip_frame{false};
+    bool skip_next_frame{false};
     static constexpr int display_capture_dimensions[4][2] = {{128, 128}, {256, 64}, {256, 128}, {256, 192}};
 
     DISPSTAT dispstat7;
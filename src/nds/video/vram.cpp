@@ -7,22 +7,15 @@ namespace nds {
 void VRAM::reset() {
     vramstat = 0;
     vramcnt.fill(VRAMCNT{});
-    bank_a.fill(0);
-    bank_b.fill(0);
-    bank_c.fill(0);
-    bank_d.fill(0);
-    bank_e.fill(0);
-    bank_f.fill(0);
-    bank_g.fill(0);
-    bank_h.fill(0);
-    bank_i.fill(0);
+    memory.fill(0);
+    generations.fill(0);
 
     lcdc.allocate(0xa4000);
     bga.allocate(0x80000);
     obja.allocate(0x40000);
     bgb.allocate(0x20000);
     objb.allocate(0x20000);
-    arm7_vram.allocate(0x20000);
+    arm7_vram.allocate(0x40000);
     texture_data.allocate(0x80000);
     texture_palette.allocate(0x20000);
     bga_extended_palette.allocate(0x8000);
@@ -33,13 +26,13 @@ void VRAM::reset() {
     reset_vram_regions();
 }
 
-void VRAM::write_vramcnt(Bank bank, u8 value) {
+bool VRAM::write_vramcnt(Bank bank, u8 value) {
     const u8 masks[] = {0x9b, 0x9b, 0x9f, 0x9f, 0x87, 0x9f, 0x9f, 0x83, 0x83};
     int index = static_cast<int>(bank);
     value &= masks[index];
 
     if (vramcnt[index].data == value) {
-        return;
+        return false;
     }
 
     vramcnt[index].data = value;
@@ -49,16 +42,16 @@ void VRAM::write_vramcnt(Bank bank, u8 value) {
         auto offset = vramcnt[0].offset;
         switch (vramcnt[0].mst) {
         case 0:
-            lcdc.map(bank_a.data(), 0, 0x20000);
+            map(lcdc, Bank::A, 0, 0x20000);
             break;
         case 1:
-            bga.map(bank_a.data(), offset * 0x20000, 0x20000);
+            map(bga, Bank::A, offset * 0x20000, 0x20000);
             break;
         case 2:
-            obja.map(bank_a.data(), common::get_bit<0>(offset) * 0x20000, 0x20000);
+            map(obja, Bank::A, common::get_bit<0>(offset) * 0x20000, 0x20000);
             break;
         case 3:
-            texture_data.map(bank_a.data(), offset * 0x20000, 0x20000);
+            map(texture_data, Bank::A, offset * 0x20000, 0x20000);
             break;
         }
     }
@@ -67,16 +60,16 @@ void VRAM::write_vramcnt(Bank bank, u8 value) {
         auto offset = vramcnt[1].offset;
         switch (vramcnt[1].mst) {
         case 0:
-            lcdc.map(bank_b.data(), 0x20000, 0x20000);
+            map(lcdc, Bank::B, 0x20000, 0x20000);
             break;
         case 1:
-            bga.map(bank_b.data(), offset * 0x20000, 0x20000);
+            map(bga, Bank::B, offset * 0x20000, 0x20000);
             break;
         case 2:
-            obja.map(bank_b.data(), common::get_bit<0>(offset) * 0x20000, 0x20000);
+            map(obja, Bank::B, common::get_bit<0>(offset) * 0x20000, 0x20000);
             break;
         case 3:
-            texture_data.map(bank_b.data(), offset * 0x20000, 0x20000);
+            map(texture_data, Bank::B, offset * 0x20000, 0x20000);
             break;
         }
     }
@@ -85,19 +78,19 @@ void VRAM::write_vramcnt(Bank bank, u8 value) {
         auto offset = vramcnt[2].offset;
         switch (vramcnt[2].mst) {
         case 0:
-            lcdc.map(bank_c.data(), 0x40000, 0x20000);
+            map(lcdc, Bank::C, 0x40000, 0x20000);
             break;
         case 1:
-            bga.map(bank_c.data(), offset * 0x20000, 0x20000);
+            map(bga, Bank::C, offset * 0x20000, 0x20000);
             break;
         case 2:
-            arm7_vram.map(bank_c.data(), common::get_bit<0>(offset) * 0x20000, 0x20000);
+            map(arm7_vram, Bank::C, common::get_bit<0>(offset) * 0x20000, 0x20000);
             break;
         case 3:
-            texture_data.map(bank_c.data(), offset * 0x20000, 0x20000);
+            map(texture_data, Bank::C, offset * 0x20000, 0x20000);
             break;
         case 4:
-            bgb.map(bank_c.data(), 0, 0x20000);
+            map(bgb, Bank::C, 0, 0x20000);
             break;
         }
     }
@@ -112,19 +105,19 @@ void VRAM::write_vramcnt(Bank bank, u8 value) {
         auto offset = vramcnt[3].offset;
         switch (vramcnt[3].mst) {
         case 0:
-            lcdc.map(bank_d.data(), 0x60000, 0x20000);
+            map(lcdc, Bank::D, 0x60000, 0x20000);
             break;
         case 1:
-            bga.map(bank_d.data(), offset * 0x20000, 0x20000);
+            map(bga, Bank::D, offset * 0x20000, 0x20000);
             break;
         case 2:
-            arm7_vram.map(bank_d.data(), common::get_bit<0>(offset) * 0x20000, 0x20000);
+            map(arm7_vram, Bank::D, common::get_bit<0>(offset) * 0x20000, 0x20000);
             break;
         case 3:
-            texture_data.map(bank_d.data(), offset * 0x20000, 0x20000);
+            map(texture_data, Bank::D, offset * 0x20000, 0x20000);
             break;
         case 4:
-            objb.map(bank_d.data(), 0, 0x20000);
+            map(objb, Bank::D, 0, 0x20000);
             break;
         }
     }
@@ -138,19 +131,19 @@ void VRAM::write_vramcnt(Bank bank, u8 value) {
     if (vramcnt[4].enable) {
         switch (vramcnt[4].mst) {
         case 0:
-            lcdc.map(bank_e.data(), 0x80000, 0x10000);
+            map(lcdc, Bank::E, 0x80000, 0x10000);
             break;
         case 1:
-            bga.map(bank_e.data(), 0, 0x10000);
+            map(bga, Bank::E, 0, 0x10000);
             break;
         case 2:
-            obja.map(bank_e.data(), 0, 0x10000);
+            map(obja, Bank::E, 0, 0x10000);
             break;
         case 3:
-            texture_palette.map(bank_e.data(), 0, 0x10000);
+            map(texture_palette, Bank::E, 0, 0x10000);
             break;
         case 4:
-            bga_extended_palette.map(bank_e.data(), 0, 0x8000);
+            map(bga_extended_palette, Bank::E, 0, 0x8000);
             break;
         }
     }
@@ -159,22 +152,22 @@ void VRAM::write_vramcnt(Bank bank, u8 value) {
         auto offset = vramcnt[5].offset;
         switch (vramcnt[5].mst) {
         case 0:
-            lcdc.map(bank_f.data(), 0x90000, 0x4000);
+            map(lcdc, Bank::F, 0x90000, 0x4000);
             break;
         case 1:
-            bga.map(bank_f.data(), common::get_bit<0>(offset) * 0x4000 + common::get_bit<1>(offset) * 0x10000, 0x4000);
+            map(bga, Bank::F, common::get_bit<0>(offset) * 0x4000 + common::get_bit<1>(offset) * 0x10000, 0x4000);
             break;
         case 2:
-            obja.map(bank_f.data(), common::get_bit<0>(offset) * 0x4000 + common::get_bit<1>(offset) * 0x10000, 0x4000);
+            map(obja, Bank::F, common::get_bit<0>(offset) * 0x4000 + common::get_bit<1>(offset) * 0x10000, 0x4000);
             break;
         case 3:
-            texture_palette.map(bank_f.data(), (common::get_bit<0>(offset) + common::get_bit<1>(offset) * 4) * 0x4000, 0x4000);
+            map(texture_palette, Bank::F, (common::get_bit<0>(offset) + common::get_bit<1>(offset) * 4) * 0x4000, 0x4000);
             break;
         case 4:
-            bga_extended_palette.map(bank_f.data(), common::get_bit<0>(offset) * 0x4000, 0x4000);
+            map(bga_extended_palette, Bank::F, common::get_bit<0>(offset) * 0x4000, 0x4000);
             break;
         case 5:
-            obja_extended_palette.map(bank_f.data(), 0, 0x2000);
+            map(obja_extended_palette, Bank::F, 0, 0x2000);
             break;
         }
     }
@@ -183,22 +176,22 @@ void VRAM::write_vramcnt(Bank bank, u8 value) {
         auto offset = vramcnt[6].offset;
         switch (vramcnt[6].mst) {
         case 0:
-            lcdc.map(bank_g.data(), 0x94000, 0x4000);
+            map(lcdc, Bank::G, 0x94000, 0x4000);
             break;
         case 1:
-            bga.map(bank_g.data(), common::get_bit<0>(offset) * 0x4000 + common::get_bit<1>(offset) * 0x10000, 0x4000);
+            map(bga, Bank::G, common::get_bit<0>(offset) * 0x4000 + common::get_bit<1>(offset) * 0x10000, 0x4000);
             break;
         case 2:
-            obja.map(bank_g.data(), common::get_bit<0>(offset) * 0x4000 + common::get_bit<1>(offset) * 0x10000, 0x4000);
+            map(obja, Bank::G, common::get_bit<0>(offset) * 0x4000 + common::get_bit<1>(offset) * 0x10000, 0x4000);
             break;
         case 3:
-            texture_palette.map(bank_g.data(), (common::get_bit<0>(offset) + common::get_bit<1>(offset) * 4) * 0x4000, 0x4000);
+            map(texture_palette, Bank::G, (common::get_bit<0>(offset) + common::get_bit<1>(offset) * 4) * 0x4000, 0x4000);
             break;
         case 4:
-            bga_extended_palette.map(bank_g.data(), common::get_bit<0>(offset) * 0x4000, 0x4000);
+            map(bga_extended_palette, Bank::G, common::get_bit<0>(offset) * 0x4000, 0x4000);
             break;
         case 5:
-            obja_extended_palette.map(bank_g.data(), 0, 0x2000);
+            map(obja_extended_palette, Bank::G, 0, 0x2000);
             break;
         }
     }
@@ -206,13 +199,13 @@ void VRAM::write_vramcnt(Bank bank, u8 value) {
     if (vramcnt[7].enable) {
         switch (vramcnt[7].mst) {
         case 0:
-            lcdc.map(bank_h.data(), 0x98000, 0x8000);
+            map(lcdc, Bank::H, 0x98000, 0x8000);
             break;
         case 1:
-            bgb.map(bank_h.data(), 0, 0x8000);
+            map(bgb, Bank::H, 0, 0x8000);
             break;
         case 2:
-            bgb_extended_palette.map(bank_h.data(), 0, 0x8000);
+            map(bgb_extended_palette, Bank::H, 0, 0x8000);
             break;
         }
     }
@@ -220,19 +213,26 @@ void VRAM::write_vramcnt(Bank bank, u8 value) {
     if (vramcnt[8].enable) {
         switch (vramcnt[8].mst) {
         case 0:
-            lcdc.map(bank_i.data(), 0xa0000, 0x4000);
+            map(lcdc, Bank::I, 0xa0000, 0x4000);
             break;
         case 1:
-            bgb.map(bank_i.data(), 0x8000, 0x4000);
+            map(bgb, Bank::I, 0x8000, 0x4000);
             break;
         case 2:
-            objb.map(bank_i.data(), 0, 0x4000);
+            map(objb, Bank::I, 0, 0x4000);
             break;
         case 3:
-            objb_extended_palette.map(bank_i.data(), 0, 0x2000);
+            map(objb_extended_palette, Bank::I, 0, 0x2000);
             break;
         }
     }
+
+    return true;
+}
+
+void VRAM::map(VRAMRegion& region, Bank bank, u32 offset, u32 length) {
+    u32 bank_offset = bank_offsets[static_cast<int>(bank)];
+    region.map(memory.data() + bank_offset, generations.data() + (bank_offset >> 12), offset, length);
 }
 
 void VRAM::reset_vram_regions() {
@@ -246,6 +246,8 @@ void VRAM::reset_vram_regions() {
     texture_palette.reset();
     bga_extended_palette.reset();
     bgb_extended_palette.reset();
+    obja_extended_palette.reset();
+    objb_extended_palette.reset();
 }
 
 } // namespace nds
\ No newline at end of file
@@ -62,6 +62,24 @@ public:
         }
     }
 
+    // returns a direct pointer to the 4kb page containing addr as seen by the arm9,
+    // or nullptr if the access has to go through the slow path
+    u8* get_pointer(u32 addr) {
+        auto region = (addr >> 20) & 0xf;
+        switch (region) {
+        case 0x0: case 0x1:
+            return bga.get_pointer(addr);
+        case 0x2: case 0x3:
+            return bgb.get_pointer(addr);
+        case 0x4: case 0x5:
+            return obja.get_pointer(addr);
+        case 0x6: case 0x7:
+            return objb.get_pointer(addr);
+        default:
+            return lcdc.get_pointer(addr);
+        }
+    }
+
     template <typename T>
     T read_arm7(u32 addr) {
         return arm7_vram.read<T>(addr);
@@ -75,7 +93,8 @@ public:
     u8 read_vramstat() { return vramstat; }
 
     u8 read_vramcnt(Bank bank) { return vramcnt[static_cast<int>(bank)].data; }
-    void write_vramcnt(Bank bank, u8 value);
+    // returns true if the bank mappings were changed
+    bool write_vramcnt(Bank bank, u8 value);
 
     VRAMRegion lcdc;
     VRAMRegion bga;
@@ -91,6 +110,7 @@ public:
     VRAMRegion objb_extended_palette;
 
 private:
+    void map(VRAMRegion& region, Bank bank, u32 offset, u32 length);
     void reset_vram_regions();
 
     u8 vramstat;
@@ -108,15 +128,13 @@ private:
 
     std::array<VRAMCNT, 9> vramcnt;
 
-    std::array<u8, 0x20000> bank_a;
-    std::array<u8, 0x20000> bank_b;
-    std::array<u8, 0x20000> bank_c;
-    std::array<u8, 0x20000> bank_d;
-    std::array<u8, 0x10000> bank_e;
-    std::array<u8, 0x4000> bank_f;
-    std::array<u8, 0x4000> bank_g;
-    std::array<u8, 0x8000> bank_h;
-    std::array<u8, 0x4000> bank_i;
+    // all banks are stored contiguously in the same layout as lcdc mode
+    std::array<u8, 0xa4000> memory;
+
+    // a write counter for each 4kb page of vram
+    std::array<u32, 0xa4> generations;
+
+    static constexpr u32 bank_offsets[9] = {0x00000, 0x20000, 0x40000, 0x60000, 0x80000, 0x90000, 0x94000, 0x98000, 0xa0000};
 };
 
 } // namespace nds
\ No newline at end of file
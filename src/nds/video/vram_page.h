@@ -1,25 +1,48 @@
 #pragma once
 
-#include <vector>
+#include <array>
 #include "common/types.h"
 #include "common/memory.h"
 
 namespace nds {
 
+// a vram page can have multiple banks mapped to it at once, in which case
+// reads are or'd together and writes go to every bank
 class VRAMPage {
 public:
     void reset() {
-        banks.clear();
+        num_banks = 0;
     }
 
-    void add_bank(u8* pointer) {
-        banks.push_back(pointer);
+    void add_bank(u8* pointer, u32* generation) {
+        banks[num_banks] = pointer;
+        generations[num_banks] = generation;
+        num_banks++;
+    }
+
+    // returns a direct pointer to the page if only a single bank is mapped
+    u8* get_pointer() {
+        return num_banks == 1 ? banks[0] : nullptr;
+    }
+
+    u32* get_generation_pointer() {
+        return num_banks == 1 ? generations[0] : nullptr;
+    }
+
+    // returns the sum of the write counters of each mapped bank
+    u64 get_generation() {
+        u64 generation = 0;
+        for (int i = 0; i < num_banks; i++) {
+            generation += *generations[i];
+        }
+
+        return generation;
     }
 
     template <typename T>
     T read(u32 addr) {
         T data = 0;
-        for (u64 i = 0; i < banks.size(); i++) {
+        for (int i = 0; i < num_banks; i++) {
             data |= common::read<T>(&banks[i][addr & PAGE_MASK]);
         }
 
@@ -28,16 +51,19 @@ public:
 
     template <typename T>
     void write(u32 addr, T value) {
-        for (u64 i = 0; i < banks.size(); i++) {
+        for (int i = 0; i < num_banks; i++) {
             common::write<T>(&banks[i][addr & PAGE_MASK], value);
+            (*generations[i])++;
         }
     }
 
 private:
-    std::vector<u8*> banks;
+    std::array<u8*, 9> banks;
+    std::array<u32*, 9> generations;
+    int num_banks{0};
 
     constexpr static int PAGE_SIZE = 0x1000;
     constexpr static int PAGE_MASK = PAGE_SIZE - 1;
 };
 
-} // namespace nds
\ No newline at end of file
+} // namespace nds
@@ -1,8 +1,12 @@
 #pragma once
 
-#include <array>
+#include <vector>
+#include <algorithm>
+#include <bit>
+#include <cstring>
 #include "common/types.h"
 #include "common/logger.h"
+#include "common/memory.h"
 #include "nds/video/vram_page.h"
 
 namespace nds {
@@ -13,49 +17,119 @@ public:
         for (auto& page : pages) {
             page.reset();
         }
+
+        std::fill(page_pointers.begin(), page_pointers.end(), nullptr);
+        std::fill(page_generations.begin(), page_generations.end(), nullptr);
+        mapping_generation++;
     }
 
     template <typename T>
     T read(u32 addr) {
-        return get_vram_page(addr).template read<T>(addr);
+        auto index = get_page_index(addr);
+        auto pointer = page_pointers[index];
+        if (pointer) {
+            return common::read<T>(pointer, addr & PAGE_MASK);
+        }
+
+        return pages[index].template read<T>(addr);
     }
 
     template <typename T>
     void write(u32 addr, T data) {
-        get_vram_page(addr).template write<T>(addr, data);
+        auto index = get_page_index(addr);
+        auto pointer = page_pointers[index];
+        if (pointer) {
+            common::write<T>(pointer, data, addr & PAGE_MASK);
+            (*page_generations[index])++;
+            return;
+        }
+
+        pages[index].template write<T>(addr, data);
     }
 
-    void allocate(u32 size) {
-        pages.clear();
+    // copies a run of halfwords which must stay within a single page,
+    // going through the page directly when possible
+    void read_block(u32 addr, u16* data, int count) {
+        auto index = get_page_index(addr);
+        auto pointer = page_pointers[index];
+        if (pointer) {
+            std::memcpy(data, pointer + (addr & PAGE_MASK), count * sizeof(u16));
+            return;
+        }
+
+        for (int i = 0; i < count; i++) {
+            data[i] = pages[index].template read<u16>(addr + (i * 2));
+        }
+    }
+
+    void write_block(u32 addr, const u16* data, int count) {
+        auto index = get_page_index(addr);
+        auto pointer = page_pointers[index];
+        if (pointer) {
+            std::memcpy(pointer + (addr & PAGE_MASK), data, count * sizeof(u16));
+            (*page_generations[index])++;
+            return;
+        }
+
+        for (int i = 0; i < count; i++) {
+            pages[index].template write<u16>(addr + (i * 2), data[i]);
+        }
+    }
+
+    // returns a pointer to the start of the page containing addr, or nullptr
+    // if the page has either no banks or multiple overlapping banks mapped
+    u8* get_pointer(u32 addr) {
+        return page_pointers[get_page_index(addr)];
+    }
 
-        auto pages_to_allocate = size / PAGE_SIZE;
-        for (u64 i = 0; i < pages_to_allocate; i++) {
-            VRAMPage page;
-            pages.push_back(page);
+    // returns a value which changes whenever memory within the given range is written
+    // or the region gets remapped
+    u64 get_generation(u32 addr, u32 size) {
+        u64 generation = static_cast<u64>(mapping_generation) << 32;
+        u32 first = addr >> 12;
+        u32 last = (addr + size - 1) >> 12;
+        for (u32 i = first; i <= last; i++) {
+            generation += pages[i & page_mask].get_generation();
         }
+
+        return generation;
+    }
+
+    void allocate(u32 size) {
+        // round up to a power of 2 so that addresses mirror with a single mask
+        auto pages_to_allocate = std::bit_ceil(size / PAGE_SIZE);
+        pages.clear();
+        pages.resize(pages_to_allocate);
+        page_pointers.clear();
+        page_pointers.resize(pages_to_allocate, nullptr);
+        page_generations.clear();
+        page_generations.resize(pages_to_allocate, nullptr);
+        page_mask = pages_to_allocate - 1;
     }
 
-    void map(u8* pointer, u32 offset, u32 length) {
+    void map(u8* pointer, u32* generations, u32 offset, u32 length) {
         auto pages_to_map = length / PAGE_SIZE;
         for (u64 i = 0; i < pages_to_map; i++) {
             auto index = (offset / PAGE_SIZE) + i;
-            pages[index].add_bank(pointer + (i * PAGE_SIZE));
+            pages[index].add_bank(pointer + (i * PAGE_SIZE), generations + i);
+            page_pointers[index] = pages[index].get_pointer();
+            page_generations[index] = pages[index].get_generation_pointer();
         }
     }
 
 private:
-    VRAMPage& get_vram_page(u32 addr) {
-        addr &= 0xffffff;
-
-        int region = (addr >> 20) & 0xf;
-        u32 offset = addr - (region * 0x100000);
-        int index = offset >> 12;
-        return pages[index];
+    u32 get_page_index(u32 addr) {
+        return (addr >> 12) & page_mask;
     }
 
     constexpr static int PAGE_SIZE = 0x1000;
+    constexpr static u32 PAGE_MASK = PAGE_SIZE - 1;
     
     std::vector<VRAMPage> pages;
+    std::vector<u8*> page_pointers;
+    std::vector<u32*> page_generations;
+    u32 page_mask{0};
+    u32 mapping_generation{0};
 };
 
-} // namespace nds
\ No newline at end of file
+} // namespace nds